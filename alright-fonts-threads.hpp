@@ -0,0 +1,180 @@
+// threaded loading for alright-fonts, includes alright-fonts.hpp and needs
+// the platform's thread library to be linked. nothing in alright-fonts.hpp
+// itself needs threads
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "alright-fonts.hpp"
+
+namespace alright_fonts {
+
+  // a fixed set of threads that run queued tasks in the order they were
+  // submitted, shared by anything that wants work done in the background
+  struct worker_pool_t {
+    deque<function<void()>> tasks;
+    mutex queue_lock;
+    condition_variable queue_ready;
+    bool stopping = false;
+    vector<thread> threads;
+
+    worker_pool_t(unsigned count = thread::hardware_concurrency());
+    ~worker_pool_t();
+
+    worker_pool_t(const worker_pool_t &) = delete;
+    worker_pool_t &operator=(const worker_pool_t &) = delete;
+
+    // queues a task, the future holds its result once a worker has run it
+    template<typename F> auto submit(F f) -> future<decltype(f())> {
+      auto task = make_shared<packaged_task<decltype(f())()>>(move(f));
+      future<decltype(f())> result = task->get_future();
+      queue(function<void()>([task]() {(*task)();}), 1);
+      return result;
+    }
+
+    // calls fn(i) for every i below count spread over the workers and the
+    // calling thread, returning once all of the calls have finished. the
+    // caller takes work too so it's safe to call from a task on this pool
+    // even when every worker is busy
+    template<typename F> void run(size_t count, F fn) {
+      struct state_t {
+        atomic<size_t> next{0};
+        size_t done = 0;
+        mutex lock;
+        condition_variable finished;
+      };
+
+      // workers that only get to their task after every index is taken do
+      // nothing, so never touch fn after this returns
+      auto state = make_shared<state_t>();
+      auto work = [state, count, &fn]() {
+        size_t i, ran = 0;
+        while((i = state->next++) < count) {
+          fn(i);
+          ran++;
+        }
+        if(ran > 0) {
+          lock_guard<mutex> guard(state->lock);
+          state->done += ran;
+          if(state->done == count) {state->finished.notify_all();}
+        }
+      };
+
+      queue(function<void()>(work), min(threads.size(), count > 0 ? count - 1 : 0));
+      work();
+
+      unique_lock<mutex> guard(state->lock);
+      state->finished.wait(guard, [&state, count]() {return state->done == count;});
+    }
+
+    void queue(function<void()> task, size_t copies);
+  };
+
+  // a face being loaded on a worker pool by load_async(), copies share the
+  // same face. text can be drawn with get(), which waits for the load to
+  // finish, or with get_or() which gives a fallback face until then
+  struct pending_face_t {
+    shared_ptr<face_t> face;
+    shared_future<bool> loaded;
+
+    // only made by load_async() so there is always a load to wait for
+    pending_face_t(shared_ptr<face_t> face, shared_future<bool> loaded) : face(face), loaded(loaded) {}
+
+    // a moved from pending face has no load and never becomes ready
+    bool ready() const {return loaded.valid() && loaded.wait_for(chrono::seconds(0)) == future_status::ready;}
+
+    // blocks until the face has loaded, false if it failed to
+    bool wait() const {return loaded.valid() && loaded.get();}
+
+    face_t &get() const {wait(); return *face;}
+    face_t &get_or(face_t &fallback) const {return ready() && wait() ? *face : fallback;}
+  };
+
+  // a runner for face_t::load() that decodes the contours of large faces in
+  // parallel on the pool
+  inline decode_runner_t pool_runner(worker_pool_t &pool);
+
+  // starts loading a face on the pool and returns straight away, loading
+  // several this way reads and decodes them all at once. the pool must
+  // outlive the load
+  inline pending_face_t load_async(worker_pool_t &pool, string path);
+
+
+  /*
+    worker pool functions
+  */
+
+  inline worker_pool_t::worker_pool_t(unsigned count) {
+    for(unsigned i = 0; i < max(count, 1u); i++) {
+      threads.emplace_back([this]() {
+        while(true) {
+          function<void()> task;
+          {
+            unique_lock<mutex> guard(queue_lock);
+            queue_ready.wait(guard, [this]() {return stopping || !tasks.empty();});
+            if(tasks.empty()) {
+              // stopping and every queued task has run
+              return;
+            }
+            task = move(tasks.front());
+            tasks.pop_front();
+          }
+          task();
+        }
+      });
+    }
+  }
+
+  inline worker_pool_t::~worker_pool_t() {
+    {
+      lock_guard<mutex> guard(queue_lock);
+      stopping = true;
+    }
+    queue_ready.notify_all();
+    for(auto &t : threads) {
+      t.join();
+    }
+  }
+
+  inline void worker_pool_t::queue(function<void()> task, size_t copies) {
+    {
+      lock_guard<mutex> guard(queue_lock);
+      for(size_t i = 0; i < copies; i++) {
+        tasks.push_back(task);
+      }
+    }
+    queue_ready.notify_all();
+  }
+
+
+  /*
+    load functions
+  */
+
+  inline decode_runner_t pool_runner(worker_pool_t &pool) {
+    return [&pool](size_t count, const decode_range_t &decode) {
+      // a few chunks per thread so that uneven glyphs even out, each
+      // records its own result so nothing is shared between them
+      size_t chunks = min<size_t>(count, (pool.threads.size() + 1) * 4);
+      vector<uint8_t> decoded(chunks, 0);
+      pool.run(chunks, [&](size_t chunk) {
+        decoded[chunk] = decode(chunk * count / chunks, (chunk + 1) * count / chunks);
+      });
+      return all_of(decoded.begin(), decoded.end(), [](uint8_t ok) {return ok != 0;});
+    };
+  }
+
+  inline pending_face_t load_async(worker_pool_t &pool, string path) {
+    auto face = make_shared<face_t>();
+    shared_future<bool> loaded = pool.submit([face, path, &pool]() {return face->load(path, pool_runner(pool));}).share();
+    return pending_face_t(face, loaded);
+  }
+
+}
@@ -1,12 +1,21 @@
+#pragma once
+
 #include <cstdint>
 #include <math.h>
 #include <string.h>
+#include <string_view>
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
 #include <vector>
 #include <optional>
 #include <map>
+#include <tuple>
+#include <array>
+#include <memory>
+#include <cassert>
+#include <functional>
+#include <type_traits>
 
 #include "pretty-poly/pretty-poly.hpp"
 
@@ -15,23 +24,431 @@ using namespace std;
 
 namespace alright_fonts {
 
+  // header flags, a parser must reject a file with any flag set that it
+  // doesn't implement
+  enum flags_t {
+    shared_contours     = 1 << 0,     // contours may reference earlier ones
+    detail_levels       = 1 << 1,     // glyphs store lower detail contours
+    quadratic_contours  = 1 << 2,     // contours include curve control points
+    absolute_offsets    = 1 << 3,     // dictionary holds contour data offsets
+
+    // optional flags in the top byte may be ignored instead, their data
+    // comes after all of the glyph contour data so skipping it is harmless
+    embedded_strikes    = 1 << 8      // pre-rendered bitmaps for some sizes
+  };
+
+  constexpr uint16_t supported_flags = shared_contours | detail_levels | quadratic_contours | absolute_offsets | embedded_strikes;
+  constexpr uint16_t optional_flags = 0xff00;
+
+  // with absolute_offsets each dictionary entry is followed by the 32-bit
+  // offset of its contour data from the start of the file, so a glyph can be
+  // found without adding up the lengths of the glyphs before it
+  constexpr uint16_t glyph_entry_size(uint16_t flags) {
+    return flags & absolute_offsets ? 13 : 9;
+  }
+
+  // with shared_contours set a contour count with the top bit set is instead
+  // the index of an earlier contour in the face, followed by an x and y
+  // offset to apply to it
+  constexpr uint16_t contour_reference = 0x8000;
+
+  // 26.6 fixed point (64ths of a pixel) used for sizes and positions so that
+  // text can be sized and placed at fractions of a pixel
+  typedef int32_t fixed_t;
+
+  constexpr fixed_t to_fixed(int v) {return v * 64;}
+  constexpr fixed_t to_fixed(float v) {return fixed_t(v * 64.0f + (v < 0.0f ? -0.5f : 0.5f));}
+  constexpr fixed_t to_fixed(double v) {return fixed_t(v * 64.0 + (v < 0.0 ? -0.5 : 0.5));}
+  constexpr int fixed_floor(fixed_t v) {return v >> 6;}
+  constexpr int fixed_round(fixed_t v) {return (v + 32) >> 6;}
+  constexpr int fixed_ceil(fixed_t v) {return (v + 63) >> 6;}
+
+  // a position in 26.6 fixed point, made with fixed_point() so that braced
+  // pixel positions like {10, 20} unambiguously mean point_t<int>
+  struct fixed_point_t {
+    fixed_t x = 0, y = 0;
+
+    constexpr fixed_point_t() {}
+    explicit fixed_point_t(point_t<int> p) : x(to_fixed(p.x)), y(to_fixed(p.y)) {}
+
+    bool operator==(const fixed_point_t &o) const {return x == o.x && y == o.y;}
+  };
+
+  constexpr fixed_point_t fixed_point(fixed_t x, fixed_t y) {
+    fixed_point_t p;
+    p.x = x;
+    p.y = y;
+    return p;
+  }
+
+  // glyphs are drawn at one of this many evenly spaced offsets between whole
+  // pixels on each axis, few enough that anything cached per offset is
+  // still reused often
+  constexpr int subpixel_shift = 2;
+  constexpr int subpixel_bins = 1 << subpixel_shift;
+
   struct glyph_t {
+    // a lower detail copy of the contours for sizes up to max_size pixels
+    struct detail_t {
+      uint8_t max_size;
+      vector<contour_t<int8_t>> contours;
+    };
+
     uint16_t codepoint;
     rect_t bounds;
     uint8_t advance;
     vector<contour_t<int8_t>> contours;
+    vector<detail_t> details;         // smallest max_size first
+
+    // glyphs are owned by their face and only ever passed around by
+    // reference or pointer, copying one would copy all of its contours
+    glyph_t() {}
+    glyph_t(glyph_t &&) = default;
+    glyph_t &operator=(glyph_t &&) = default;
+    glyph_t(const glyph_t &) = delete;
+    glyph_t &operator=(const glyph_t &) = delete;
+
+    // with quadratic_contours a bitmask per contour with a bit set for each
+    // point that is an off curve control point, bit (i & 7) of byte i >> 3.
+    // the contours then need flattening with flatten_contour() to be drawn
+    vector<const uint8_t *> controls;
+
+    // with embedded_strikes a pre-rendered coverage bitmap for a pixel size,
+    // the top left corner is at x, y from the origin and pixels are packed
+    // row by row, most significant bits first
+    struct bitmap_t {
+      uint8_t size;
+      uint8_t bits;                   // per pixel, 1, 2, 4, or 8
+      int8_t x, y;
+      uint8_t w, h;
+      const uint8_t *data;
+    };
+
+    vector<bitmap_t> bitmaps;
+
+    // the bitmap for a size if there is one, only whole pixel sizes match
+    const bitmap_t *bitmap_for(fixed_t size) const {
+      for(auto &bitmap : bitmaps) {
+        if(size == bitmap.size * 64) {return &bitmap;}
+      }
+      return nullptr;
+    }
+
+    // the contours to draw at a pixel size
+    const vector<contour_t<int8_t>> &contours_for(int size) const {
+      for(auto &detail : details) {
+        if(size <= detail.max_size) {return detail.contours;}
+      }
+      return contours;
+    }
+  };
+
+  // points that a face owns itself rather than pointing into its data, like
+  // moved copies of shared contours. handed out from blocks that never move
+  // so contours can point into them
+  struct point_arena_t {
+    vector<unique_ptr<point_t<int8_t>[]>> blocks;
+    size_t used = 0, capacity = 0;
+
+    point_t<int8_t> *allocate(size_t count) {
+      if(used + count > capacity) {
+        capacity = max<size_t>(count, 4096);
+        blocks.push_back(make_unique<point_t<int8_t>[]>(capacity));
+        used = 0;
+      }
+      point_t<int8_t> *points = blocks.back().get() + used;
+      used += count;
+      return points;
+    }
+
+    void clear() {blocks.clear(); used = 0; capacity = 0;}
   };
 
+  // decodes glyphs first to last of a face being loaded, false if any
+  // couldn't be read
+  typedef function<bool(size_t first, size_t last)> decode_range_t;
+
+  // hands out the decoding of count glyphs in ranges and returns once every
+  // range is done, true if all of them decoded. ranges never overlap so may
+  // be decoded at the same time on other threads, alright-fonts-threads.hpp
+  // has one that uses a worker pool
+  typedef function<bool(size_t count, const decode_range_t &decode)> decode_runner_t;
+
   struct face_t {
     uint16_t glyph_count;
     uint16_t flags;
+    vector<uint8_t> detail_sizes;     // max_size of each glyph detail level
     std::map<uint16_t, glyph_t> glyphs;
 
+    // the glyphs again as separate arrays in codepoint order so that lookups
+    // only touch codepoints, and measuring only advances and bounds. built on
+    // load, while it isn't built find() falls back to the map. contours stay
+    // in the glyphs, they already point into the face's storage in file order
+    struct index_t {
+      vector<uint16_t> codepoints;
+      vector<uint8_t> advances;
+      vector<rect_t> bounds;
+      vector<const glyph_t *> glyphs;
+      bool built = false;
+
+      void clear() {codepoints.clear(); advances.clear(); bounds.clear(); glyphs.clear(); built = false;}
+    } index;
+
+    // the file the glyphs point into if loaded from a path or stream
+    shared_ptr<const vector<uint8_t>> storage;
+
+    // points of moved contour references, which can't point into the file
+    point_arena_t moved_points;
+
+    face_t() : glyph_count(0), flags(0) {}
     face_t(ifstream &ifs) {load(ifs);}
     face_t(string path) {load(path);}
+    face_t(const uint8_t *data, size_t size) {load(data, size);}
+
+    // faces own their glyphs so can be moved but not copied, a moved map
+    // keeps its nodes where they are so the index stays valid
+    face_t(face_t &&) = default;
+    face_t &operator=(face_t &&) = default;
+    face_t(const face_t &) = delete;
+    face_t &operator=(const face_t &) = delete;
     
+    // with a runner the contours of large faces are decoded through it
+    bool load(ifstream &ifs, const decode_runner_t &runner = nullptr);
+    bool load(string path, const decode_runner_t &runner = nullptr);
+    bool load(const uint8_t *data, size_t size, const decode_runner_t &runner = nullptr);
+
+    // a decoded face is the face written out after loading as flat records
+    // and one arena of point data. loading it still builds the glyphs but
+    // skips contour decoding and copies no point data, from memory the face
+    // points into data which must outlive it. verify checks the whole file
+    // against its checksum, without it only offsets and lengths are checked
+    bool save_decoded(string path) const;
+    bool load_decoded(const uint8_t *data, size_t size, bool verify = true);
+    bool load_decoded(string path, bool verify = true);
+
+    // glyphs added or removed other than with add_glyph() and remove_glyph()
+    // must be followed by build_index() or index.clear()
+    void build_index();
+
+    // these leave the index unbuilt until build_index() is next called
+    glyph_t &add_glyph(glyph_t glyph) {
+      index.clear();
+      uint16_t codepoint = glyph.codepoint;
+      return glyphs.insert_or_assign(codepoint, move(glyph)).first->second;
+    }
+
+    bool remove_glyph(uint16_t codepoint) {
+      index.clear();
+      return glyphs.erase(codepoint) > 0;
+    }
+
+    // position of a codepoint in the index or -1 if not present, only
+    // meaningful while the index is built
+    int lookup(uint16_t codepoint) const {
+      auto it = lower_bound(index.codepoints.begin(), index.codepoints.end(), codepoint);
+      return it != index.codepoints.end() && *it == codepoint ? it - index.codepoints.begin() : -1;
+    }
+
+    // returns the glyph for a codepoint or nullptr if not present
+    const glyph_t *find(uint16_t codepoint) const {
+      if(!index.built) {
+        auto it = glyphs.find(codepoint);
+        return it != glyphs.end() ? &it->second : nullptr;
+      }
+      int i = lookup(codepoint);
+      return i >= 0 ? index.glyphs[i] : nullptr;
+    }
+  };
+
+  // a face compiled into the program as constant data (generated by
+  // `afinate --format cpp`) which lives in flash or rodata, needs no loading,
+  // and allows lookups of literal characters to be resolved at compile time
+  struct static_glyph_t {
+    uint16_t codepoint;
+    int8_t x, y;                      // bounding box
+    uint8_t w, h;
+    uint8_t advance;
+    uint16_t contour;                 // index of first contour
+    uint16_t contour_count;
+  };
+
+  struct static_contour_t {
+    uint32_t point;                   // index of first point
+    uint16_t count;
+  };
+
+  struct static_face_t {
+    const static_glyph_t *glyphs;     // sorted by codepoint
+    uint16_t glyph_count;
+    const static_contour_t *contours;
+    const int8_t *points;             // x, y pairs
+
+    // returns the glyph for a codepoint or nullptr if not present
+    constexpr const static_glyph_t *find(uint16_t codepoint) const {
+      int lo = 0, hi = glyph_count - 1;
+      while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if(glyphs[mid].codepoint == codepoint) {return &glyphs[mid];}
+        if(glyphs[mid].codepoint < codepoint) {lo = mid + 1;} else {hi = mid - 1;}
+      }
+      return nullptr;
+    }
+  };
+
+  // a set of faces packed into a single .afc blob. the faces it hands out
+  // point directly at contour data in the blob rather than copying it, so
+  // the collection must outlive them
+  struct collection_t {
+    struct entry_t {
+      string name;
+      uint16_t glyph_count;
+      uint16_t flags;
+      uint32_t dictionary;            // offset of face glyph dictionary
+      vector<uint8_t> detail_sizes;
+    };
+
+    vector<uint8_t> storage;          // file contents if loaded from a path
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    vector<entry_t> entries;
+
+    collection_t(const uint8_t *data, size_t size) {load(data, size);}
+    collection_t(string path) {load(path);}
+    collection_t(const collection_t &) = delete;
+
+    bool load(const uint8_t *data, size_t size);
+    bool load(string path);
+
+    int find(const string &name) const;
+    bool face(size_t index, face_t &face) const;
+  };
+
+  // reads length bytes at offset from the start of a face file, returns
+  // false if they can't be read
+  typedef bool (*read_callback_t)(void *context, uint32_t offset, uint8_t *buffer, uint32_t length);
+
+  // a face read from storage that can be randomly read but not kept in
+  // memory, like external flash. loading keeps a table of where each glyph
+  // is, each glyph is then read into a buffer sized for the largest glyph
+  // just before it's drawn. faces with shared_contours can't be streamed as
+  // their glyphs refer back to contours of earlier glyphs
+  struct stream_face_t {
+    struct entry_t {
+      uint16_t codepoint;
+      uint16_t index;                 // position in the glyph dictionary
+      uint16_t length;                // of the glyph contour data
+      uint32_t offset;                // of the glyph contour data
+    };
+
+    read_callback_t read = nullptr;
+    void *context = nullptr;
+    uint16_t flags = 0;
+    uint32_t dictionary = 0;          // offset of the glyph dictionary
+    vector<uint8_t> detail_sizes;
+    vector<entry_t> entries;          // in codepoint order
+    vector<uint8_t> buffer;           // contour data of the current glyph
+    glyph_t current;
+
+    bool load(read_callback_t read, void *context);
     bool load(ifstream &ifs);
+
+    // reads a glyph, it's only valid until the next call. returns nullptr
+    // if the codepoint isn't present or the glyph couldn't be read. every
+    // glyph is returned at the same address, and the lod, raster, and sdf
+    // caches key glyphs by address, so streamed glyphs must be drawn with
+    // text metrics that have no caches attached (as render_text() does)
+    const glyph_t *glyph(uint16_t codepoint);
+
+    // advance of a glyph in font units, reads only its dictionary entry
+    int advance(uint16_t codepoint);
+
+    const entry_t *find(uint16_t codepoint) const {
+      auto it = lower_bound(entries.begin(), entries.end(), codepoint, [](const entry_t &e, uint16_t c) {return e.codepoint < c;});
+      return it != entries.end() && it->codepoint == codepoint ? &*it : nullptr;
+    }
+  };
+
+  // an ordered list of faces to draw text from, each codepoint is drawn
+  // with the first face that contains it. which face that is gets memoised
+  // in a table of 256 entry pages, allocated as codepoints in their range
+  // are first seen, so mixed script text only probes the faces once
+  struct face_chain_t {
+    vector<face_t *> faces;           // up to 254 faces in priority order
+    mutable array<unique_ptr<uint8_t[]>, 256> pages;
+
+    face_chain_t(vector<face_t *> faces) : faces(faces) {}
+
+    const glyph_t *find(uint16_t codepoint) const;
+
+    // must be called if the faces in the chain are changed or reloaded
+    void clear() {for(auto &page : pages) {page.reset();}}
+  };
+
+  // simplified copies of glyph contours for small text. at small sizes many
+  // points lie closer to the line between their neighbours than the
+  // antialiasing sample grid can resolve, dropping them leaves the rendered
+  // glyph unchanged but gives the rasteriser fewer edges. each glyph is
+  // simplified once per pixel size and antialiasing level
+  struct lod_cache_t {
+    struct entry_t {
+      vector<point_t<int8_t>> points;
+      vector<contour_t<int8_t>> contours;
+    };
+
+    // glyph, size in whole pixels, antialiasing level
+    map<tuple<const glyph_t *, int, int>, entry_t> entries;
+
+    const vector<contour_t<int8_t>> &contours(const glyph_t &glyph, int size, antialias_t antialias);
+
+    // must be called if a face in the cache is reloaded or destroyed
+    void clear() {entries.clear();}
+  };
+
+  // glyphs rasterised by one run of a program kept for the next, so text
+  // drawn at startup needs no polygon work. glyphs are keyed on codepoint,
+  // 26.6 size, antialiasing level, and subpixel bin (y * subpixel_bins + x)
+  // and a saved cache is tied to the face
+  // it was made from by a hash of the face contents, so a cache made from
+  // any other face or an older version of this one is rejected
+  struct raster_cache_t {
+    struct entry_t {
+      rect_t bounds;                  // coverage area from the origin
+      const uint8_t *data;            // bounds.w * bounds.h coverage values
+      vector<uint8_t> recorded;       // holds data if rasterised this run
+    };
+
+    // codepoint, 26.6 size, antialiasing level, subpixel bin
+    typedef tuple<uint16_t, fixed_t, int, int> key_t;
+
+    const face_t &face;
+    uint64_t hash;                    // of the face contents
+    map<key_t, entry_t> entries;
+    vector<uint8_t> storage;          // cache file if loaded from a path
+    bool record = true;               // rasterise missing glyphs into cache
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+    raster_cache_t(const face_t &face) : face(face) {clear();}
+
+    // entries loaded from memory point into data rather than copying it so
+    // it must outlive the cache, it can be a memory mapped file or flash
+    bool load(const uint8_t *data, size_t size);
     bool load(string path);
+    bool save(string path) const;
+
+    // whether a glyph belongs to the cache's face, only those can be found
+    // in or added to the cache
+    bool holds(const glyph_t &glyph) const {return face.find(glyph.codepoint) == &glyph;}
+
+    // entries are always rasterised at full detail, whether or not the text
+    // metrics they're drawn with simplify contours
+    const entry_t *find(const glyph_t &glyph, fixed_t size, antialias_t antialias, int subpixel);
+    const entry_t *add(const glyph_t &glyph, fixed_t size, antialias_t antialias, int subpixel, rect_t bounds, const vector<uint8_t> &coverage);
+
+    float hit_rate() const {return hits + misses ? float(hits) / (hits + misses) : 0.0f;}
+
+    // must be called if the face is reloaded
+    void clear();
   };
 
   enum alignment_t {
@@ -46,15 +463,198 @@ namespace alright_fonts {
   struct text_metrics_t {
     face_t &face;                     // font to write in
     int size;                         // text size in pixels
-    uint scroll;                      // vertical scroll offset
-    int line_height;                  // spacing between lines (%)
-    int letting_spacing;              // spacing between characters    
-    int word_spacing;                 // spacing between words    
-    alignment_t align;                // horizontal and vertical alignment
+    int size_fraction = 0;            // additional 64ths of a pixel of size
+    uint scroll = 0;                  // vertical scroll offset
+    int line_height = 100;            // spacing between lines (%)
+    int letting_spacing = 0;          // spacing between characters    
+    int word_spacing = 0;             // spacing between words    
+    alignment_t align = left;         // horizontal and vertical alignment
     //optional<mat3_t> transform;       // arbitrary transformation
     antialias_t antialiasing = X4;    // level of antialiasing to apply
+    face_chain_t *chain = nullptr;    // fallback faces, replaces face if set
+    lod_cache_t *lod = nullptr;       // simplify contours for small sizes
+    raster_cache_t *raster = nullptr; // reuse previously rasterised glyphs
 
     text_metrics_t(face_t &face, int size) : face(face), size(size) {}
+    text_metrics_t(face_chain_t &chain, int size) : face(*chain.faces[0]), size(size), chain(&chain) {}
+
+    // sets a fractional text size, in 26.6 fixed point
+    void set_size(fixed_t size) {this->size = size >> 6; this->size_fraction = size & 63;}
+  };
+
+
+  // a line of laid out text, stored as a byte range into the source string
+  struct line_t {
+    uint32_t offset;                  // byte offset of first character
+    uint32_t length;                  // length of line in bytes
+    int width;                        // width of line in pixels
+  };
+
+  // a long, read only, block of text laid out once and then rendered a
+  // viewport at a time. every line of a document shares the face and size
+  // of its text metrics so the line pitch is fixed and mapping a scroll
+  // offset to the first visible line is a single divide
+  struct document_t {
+    text_metrics_t &tm;
+    string text;
+    int width;                        // wrapping width in pixels
+    vector<line_t> lines;
+
+    document_t(text_metrics_t &tm, int width) : tm(tm), width(width) {}
+
+    void set_text(const string &text);
+    void layout();
+    int height() const;
+    size_t first_visible_line() const;
+    void render(rect_t viewport);
+  };
+
+  // an editable block of text that keeps the running width of every
+  // character and the start of every wrapped line. an edit only re-wraps
+  // from the line before it until a new line start lines up with an old
+  // one, after which the rest of the layout is known to be unchanged
+  struct paragraph_t {
+    text_metrics_t &tm;
+    int width;                        // wrapping width in pixels
+    vector<uint16_t> codepoints;
+    vector<fixed_t> prefix;           // width of codepoints [0, i) (26.6)
+    vector<uint32_t> breaks;          // index of first character of each line
+
+    paragraph_t(text_metrics_t &tm, int width) : tm(tm), width(width) {layout();}
+
+    void set_text(const string &text);
+    void insert(size_t index, const string &text);
+    void erase(size_t index, size_t count);
+    void layout();
+
+    size_t line_count() const {return breaks.size();}
+    size_t line_of(size_t index) const;
+    int line_width(size_t line) const;
+    point_t<int> caret(size_t index) const;
+    void render(point_t<int> origin);
+
+  private:
+    size_t wrap_line(size_t start) const;
+    void rewrap(size_t end, size_t line, vector<uint32_t> tail);
+  };
+
+  // a glyph drawn by a label, bounds covers every pixel it can touch
+  struct cell_t {
+    uint16_t codepoint;
+    fixed_point_t origin;
+    rect_t bounds;
+  };
+
+  // a single line of text that remembers what it last drew. updating the
+  // text returns the areas that changed so that only those need clearing,
+  // re-rendering, and refreshing on the display
+  struct label_t {
+    text_metrics_t &tm;
+    point_t<int> origin;              // baseline position of first character
+    vector<cell_t> cells;
+    vector<cell_t> next;              // cells being laid out by update()
+
+    label_t(text_metrics_t &tm, point_t<int> origin) : tm(tm), origin(origin) {}
+
+    // the dirty rectangles are returned in a new vector, so an update that
+    // changes anything allocates
+    vector<rect_t> update(const string &text);
+    void render(rect_t area);
+    void render();
+  };
+
+  // a glyph of a shaped run, x is relative to the start of the run (26.6)
+  struct positioned_glyph_t {
+    const glyph_t *glyph;
+    uint16_t codepoint;
+    fixed_t x;
+  };
+
+  struct run_t {
+    string text;
+    vector<positioned_glyph_t> glyphs;
+    fixed_t width;                    // 26.6
+    uint32_t used;                    // cache clock value when last used
+  };
+
+  // bounded least recently used cache of laid out single line strings. runs
+  // are keyed on everything that affects glyph positions so changing the
+  // face, size, or spacing in the text metrics can never return a stale run
+  struct run_cache_t {
+    // face or chain, size, letter spacing, word spacing, hash of text
+    typedef tuple<const void *, int, int, int, size_t> key_t;
+
+    size_t capacity;
+    map<key_t, run_t> runs;
+    uint32_t clock = 0;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+    run_cache_t(size_t capacity = 32) : capacity(capacity) {}
+
+    const run_t &shape(const text_metrics_t &tm, const string &text);
+    float hit_rate() const {return hits + misses ? float(hits) / (hits + misses) : 0.0f;}
+
+    // must be called if a face in the cache is reloaded or destroyed
+    void clear() {runs.clear();}
+  };
+
+  // every glyph of a face pre-rendered at a set of sizes and packed into a
+  // single coverage bitmap. text is then drawn by handing views of it to the
+  // tile callback with no polygon work at all. the coverage values are as
+  // pretty-poly produced them so draw with the antialiasing level it was
+  // built with
+  struct atlas_t {
+    struct entry_t {
+      rect_t uv;                      // area of the atlas holding the glyph
+      int16_t x, y;                   // top left corner from the origin
+      fixed_t advance;
+    };
+
+    int width = 0, height = 0;
+    antialias_t antialias = NONE;
+    vector<uint8_t> pixels;           // width * height coverage values
+    map<pair<int, uint16_t>, entry_t> entries; // by size and codepoint
+    size_t used = 0;                  // pixels covered by glyphs
+
+    // packs every glyph at each size into an atlas width pixels wide and as
+    // tall as it needs to be, fails if a glyph is wider than the atlas
+    bool build(face_t &face, const vector<int> &sizes, antialias_t antialias, int width = 256);
+
+    const entry_t *find(int size, uint16_t codepoint) const {
+      auto it = entries.find(make_pair(size, codepoint));
+      return it != entries.end() ? &it->second : nullptr;
+    }
+
+    // fraction of the atlas covered by glyphs
+    float efficiency() const {return width && height ? float(used) / (width * height) : 0.0f;}
+  };
+
+  // a signed distance field of a glyph, the distance from each texel to the
+  // nearest edge of the outline. sampled by render_sdf() it draws the glyph
+  // at any size, or grown or shrunk for outlines and shadows, from a single
+  // small bitmap
+  struct sdf_t {
+    int resolution = 0;               // texels per 128 font units
+    int spread = 0;                   // texels of distance either side of edge
+    int x = 0, y = 0;                 // top left texel from the origin
+    int w = 0, h = 0;
+    vector<uint8_t> field;            // 128 on the edge, higher inside
+
+    bool build(const glyph_t &glyph, int resolution = 32, int spread = 4);
+  };
+
+  // one distance field per glyph, shared by every size the glyph is drawn at
+  struct sdf_cache_t {
+    int resolution, spread;
+    map<const glyph_t *, sdf_t> fields;
+
+    sdf_cache_t(int resolution = 32, int spread = 4) : resolution(resolution), spread(spread) {}
+
+    const sdf_t &field(const glyph_t &glyph);
+
+    // must be called if a face in the cache is reloaded or destroyed
+    void clear() {fields.clear();}
   };
 
 
@@ -62,9 +662,197 @@ namespace alright_fonts {
     global properties
   */
 
+  // working buffers for the render path, kept between calls so drawing
+  // only allocates while they're still growing. reserve_scratch() grows
+  // them up front to suit a face
+  struct scratch_t {
+    vector<point_t<int>> points;      // offset or flattened glyph points
+    vector<contour_t<int>> contours;
+    vector<size_t> ends;              // end of each flattened contour
+    vector<contour_t<int8_t>> static_contours;
+    vector<uint8_t> capture;          // unclipped glyph being rasterised
+    vector<uint8_t> mask;             // trimmed glyph for the raster cache
+    vector<uint8_t> pixels;           // bitmap and distance field tiles
+  };
+  inline scratch_t scratch;
+
+  // set once faces are loaded, caches are warm, and the scratch buffers are
+  // reserved to make any further allocation by the library an assertion
+  // failure in debug builds. pretty-poly's own allocations aren't covered
+  inline bool heap_locked = false;
+
+  // times the library has gone on to allocate after check_heap(), which
+  // tells its own allocations apart from pretty-poly's
+  inline long heap_allocations = 0;
+
+  inline void check_heap() {
+    heap_allocations++;
+    assert(!heap_locked && "alright-fonts allocating with heap_locked set");
+  }
+
+  // reserves room for n items, only allocating if the vector is too small
+  template<typename T> void grow(vector<T> &v, size_t n) {
+    if(n > v.capacity()) {
+      check_heap();
+      v.reserve(n);
+    }
+  }
+
+  // adds an item to the end of a vector that grows as it's filled
+  template<typename T> void append(vector<T> &v, const T &item) {
+    if(v.size() == v.capacity()) {
+      check_heap();
+    }
+    v.push_back(item);
+  }
+
   /*
     helper functions
   */
+
+  // text size in 26.6 fixed point
+  inline fixed_t fixed_size(const text_metrics_t &tm) {
+    return to_fixed(tm.size) + tm.size_fraction;
+  }
+
+  // returns the glyph to draw a codepoint with or nullptr if missing
+  inline const glyph_t *find_glyph(const text_metrics_t &tm, uint16_t codepoint) {
+    return tm.chain ? tm.chain->find(codepoint) : tm.face.find(codepoint);
+  }
+
+  // decodes the utf-8 sequence at byte offset i of text and moves i past it,
+  // codepoints outside of the 16-bit range supported by the format (and
+  // malformed sequences) are returned as the replacement character
+  constexpr uint16_t next_codepoint(string_view text, size_t &i) {
+    size_t start = i;
+    uint8_t c = text[i++];
+    if(c < 0x80) {
+      return c;
+    }
+
+    int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+    if(extra == 0) {
+      // stray continuation byte
+      return 0xfffd;
+    }
+
+    uint32_t codepoint = c & (0x3f >> extra);
+    for(; extra > 0; extra--) {
+      if(i >= text.size() || (uint8_t(text[i]) & 0xc0) != 0x80) {
+        // truncated sequence, only the lead byte is replaced so whatever
+        // follows it is still decoded as characters of its own
+        i = start + 1;
+        return 0xfffd;
+      }
+      codepoint = codepoint << 6 | (text[i++] & 0x3f);
+    }
+
+    return codepoint <= 0xffff ? codepoint : 0xfffd;
+  }
+
+  // horizontal advance of a codepoint in 26.6 fixed point including letter
+  // and word spacing, missing glyphs take up no space. advances are kept
+  // fractional so that rounding doesn't accumulate along a line
+  inline fixed_t character_advance(const text_metrics_t &tm, uint16_t codepoint) {
+    uint8_t advance;
+    if(!tm.chain && tm.face.index.built) {
+      int i = tm.face.lookup(codepoint);
+      if(i < 0) {
+        return 0;
+      }
+      advance = tm.face.index.advances[i];
+    } else {
+      const glyph_t *glyph = find_glyph(tm, codepoint);
+      if(!glyph) {
+        return 0;
+      }
+      advance = glyph->advance;
+    }
+
+    fixed_t result = ((advance * fixed_size(tm)) >> 7) + to_fixed(tm.letting_spacing);
+    if(codepoint == ' ') {
+      result += to_fixed(tm.word_spacing);
+    }
+    return result;
+  }
+
+  // distance between the tops of consecutive lines in pixels
+  inline int line_pitch(const text_metrics_t &tm) {
+    return fixed_round((fixed_size(tm) * tm.line_height) / 100);
+  }
+
+  // distance from the top of a line to its baseline in pixels, the format
+  // doesn't carry vertical metrics but glyph coordinates are normalised to
+  // the face bounding box so three quarters of the size is a fair ascent
+  inline int line_ascent(const text_metrics_t &tm) {
+    return fixed_round((fixed_size(tm) * 3) / 4);
+  }
+
+  // grows a to cover b, treating empty rectangles as having no extent
+  inline rect_t merge(const rect_t &a, const rect_t &b) {
+    if(a.empty()) {return b;}
+    if(b.empty()) {return a;}
+    int x = min(a.x, b.x), y = min(a.y, b.y);
+    return rect_t(x, y, max(a.x + a.w, b.x + b.w) - x, max(a.y + a.h, b.y + b.h) - y);
+  }
+
+  // pixel bounds of a glyph drawn with its baseline at origin, padded by a
+  // pixel to allow for coordinate rounding and antialiasing
+  inline rect_t glyph_bounds(const text_metrics_t &tm, const rect_t &bounds, fixed_point_t origin) {
+    if(bounds.w == 0 || bounds.h == 0) {
+      return rect_t();
+    }
+
+    // bounds are stored y up from the baseline, contours y down
+    fixed_t size = fixed_size(tm);
+    int x1 = fixed_floor(origin.x + ((bounds.x * size) >> 7));
+    int x2 = fixed_ceil(origin.x + (((bounds.x + bounds.w) * size + 127) >> 7));
+    int y1 = fixed_floor(origin.y + ((-(bounds.y + bounds.h) * size) >> 7));
+    int y2 = fixed_ceil(origin.y + ((-bounds.y * size + 127) >> 7));
+    return rect_t(x1 - 1, y1 - 1, x2 - x1 + 2, y2 - y1 + 2);
+  }
+
+  inline rect_t glyph_bounds(const text_metrics_t &tm, const glyph_t &glyph, fixed_point_t origin) {
+    return glyph_bounds(tm, glyph.bounds, origin);
+  }
+
+  // glyph_bounds() of a codepoint, empty if it's missing
+  inline rect_t character_bounds(const text_metrics_t &tm, uint16_t codepoint, fixed_point_t origin) {
+    if(!tm.chain && tm.face.index.built) {
+      int i = tm.face.lookup(codepoint);
+      return i >= 0 ? glyph_bounds(tm, tm.face.index.bounds[i], origin) : rect_t();
+    }
+
+    const glyph_t *glyph = find_glyph(tm, codepoint);
+    return glyph ? glyph_bounds(tm, *glyph, origin) : rect_t();
+  }
+
+  // width in pixels of the byte range [start, end) of text
+  inline int measure(const text_metrics_t &tm, const string &text, size_t start, size_t end) {
+    fixed_t width = 0;
+    while(start < end) {
+      width += character_advance(tm, next_codepoint(text, start));
+    }
+    return fixed_round(width);
+  }
+
+  // horizontal advance of a codepoint in 26.6 fixed point for a compiled in
+  // face
+  constexpr fixed_t character_advance(const static_face_t &face, int size, uint16_t codepoint) {
+    const static_glyph_t *glyph = face.find(codepoint);
+    return glyph ? (glyph->advance * to_fixed(size)) >> 7 : 0;
+  }
+
+  // width in pixels of text in a compiled in face, for literal text this
+  // can be evaluated by the compiler
+  constexpr int measure(const static_face_t &face, int size, string_view text) {
+    fixed_t width = 0;
+    for(size_t i = 0; i < text.size();) {
+      width += character_advance(face, size, next_codepoint(text, i));
+    }
+    return fixed_round(width);
+  }
+
 /*
   // returns a point from a contour based on the point size specified
   inline __attribute__((always_inline)) point_t contour_point(uint8_t *p, uint8_t ps) {    
@@ -82,121 +870,2334 @@ namespace alright_fonts {
     render functions
   */
 
-  void render_character(text_metrics_t &tm, uint16_t codepoint, point_t<int> origin) {
-    if(tm.face.glyphs.count(codepoint) == 1) {
-      glyph_t glyph = tm.face.glyphs[codepoint];
+  // splits a 26.6 position into whole pixels and the nearest subpixel bin
+  inline int quantise_subpixel(fixed_t v, int &bin) {
+    int q = (v * subpixel_bins + 32) >> 6;
+    bin = q & (subpixel_bins - 1);
+    return q >> subpixel_shift;
+  }
 
-      // scale is a fixed point 16:16 value, our font data is already scaled to
-      // -128..127 so to get the pixel size we want we can just shift the
-      // users requested size up one bit
-      unsigned scale = tm.size << 9;
+  // appends one quadratic curve from a to b, excluding a, split into just
+  // enough straight segments to keep within half an antialiasing sample of
+  // the curve. uniform steps stray at most |a - 2c + b| / 4s² from the
+  // curve so that gives the step count, the steps are then walked by
+  // forward differencing in 16.16 fixed point
+  inline void flatten_curve(point_t<int> a, point_t<int> c, point_t<int> b, int64_t k, vector<point_t<int>> &points) {
+    int64_t ddx = a.x - 2 * c.x + b.x, ddy = a.y - 2 * c.y + b.y;
 
-      draw_polygon<int8_t>(glyph.contours, origin, scale);
+    // coordinates are eighths of a font unit so half a sample is 512 / k
+    int64_t d = (ddx < 0 ? -ddx : ddx) + (ddy < 0 ? -ddy : ddy);
+    int64_t s = 1;
+    while(s < 16 && s * s * 2048 < d * k) {
+      s++;
     }
-  }
-/*
-  void render(const text_metrics_t &tm, rect_t bounds) {
-  }
 
-  void render(const text_metrics_t &tm, point_t point) {
+    int64_t x = int64_t(a.x) << 16, y = int64_t(a.y) << 16;
+    int64_t d1x = ((2 * (c.x - a.x) * s + ddx) << 16) / (s * s);
+    int64_t d1y = ((2 * (c.y - a.y) * s + ddy) << 16) / (s * s);
+    int64_t d2x = (2 * ddx << 16) / (s * s);
+    int64_t d2y = (2 * ddy << 16) / (s * s);
+    for(int64_t i = 1; i < s; i++) {
+      x += d1x; d1x += d2x;
+      y += d1y; d1y += d2y;
+      points.push_back(point_t<int>((x + 32768) >> 16, (y + 32768) >> 16));
+    }
+    points.push_back(b);
   }
-*/
 
-  /*
-    load functions
-  */
+  // appends the points of a quadratic contour flattened for a pixel size
+  // shifted up by the antialiasing level (k), in eighths of a font unit plus
+  // offset. as in truetype two control points in a row imply an on curve
+  // point halfway between them
+  inline void flatten_contour(const contour_t<int8_t> &contour, const uint8_t *control, int64_t k, point_t<int> offset, vector<point_t<int>> &points) {
+    unsigned n = contour.count;
+    auto on = [control](unsigned i) {return !(control[i >> 3] & (1 << (i & 7)));};
+    auto at = [&contour, offset](unsigned i) {
+      return point_t<int>(contour.points[i].x * 8 + offset.x, contour.points[i].y * 8 + offset.y);
+    };
+    auto mid = [](point_t<int> a, point_t<int> b) {return point_t<int>((a.x + b.x) / 2, (a.y + b.y) / 2);};
 
-  // big endian stream value helpers
-  uint16_t  ru16(ifstream &ifs) {uint8_t w[2]; ifs.read((char *)w, 2); return w[0] << 8 | w[1];}
-  int16_t   rs16(ifstream &ifs) {uint8_t w[2]; ifs.read((char *)w, 2); return w[0] << 8 | w[1];}
-  uint32_t  ru32(ifstream &ifs) {uint8_t dw[4]; ifs.read((char *)dw, 4); return dw[0] << 24 | dw[1] << 16 | dw[2] << 8 | dw[3];}
-  uint8_t   ru8(ifstream &ifs) {return ifs.get();}
-  int8_t    rs8(ifstream &ifs) {return ifs.get();}
+    // start from the first on curve point, or the implied one before the
+    // first point if they're all control points
+    unsigned first = 0;
+    while(first < n && !on(first)) {
+      first++;
+    }
+    point_t<int> start = first < n ? at(first) : mid(at(n - 1), at(0));
+    unsigned remaining = first < n ? n - 1 : n;
+    first = first < n ? first + 1 : 0;
 
-  bool face_t::load(ifstream &ifs) {
-    char marker[4];
-    ifs.read(marker, sizeof(marker));
+    size_t begin = points.size();
+    points.push_back(start);
 
-    // check header magic bytes are present
-    if(memcmp(marker, "af!?", 4) != 0) {
-      // doesn't start with magic marker
-      return false;
+    point_t<int> current = start, pending;
+    bool has_pending = false;
+    for(unsigned j = 0; j < remaining; j++) {
+      unsigned i = (first + j) % n;
+      point_t<int> p = at(i);
+      if(on(i)) {
+        if(has_pending) {
+          flatten_curve(current, pending, p, k, points);
+        } else {
+          points.push_back(p);
+        }
+        current = p;
+        has_pending = false;
+      } else {
+        if(has_pending) {
+          point_t<int> m = mid(pending, p);
+          flatten_curve(current, pending, m, k, points);
+          current = m;
+        }
+        pending = p;
+        has_pending = true;
+      }
     }
 
-    // number of glyphs embedded in font file
-    this->glyph_count = ru16(ifs);
+    if(has_pending) {
+      flatten_curve(current, pending, start, k, points);
+    }
 
-    // extract flags and ensure none set
-    this->flags = ru16(ifs);
-    if(this->flags != 0) {
-      // unknown flags set
-      return false;
+    // the contour closes itself, drop any repeat of the start point
+    if(points.size() - begin > 1 && points.back().x == start.x && points.back().y == start.y) {
+      points.pop_back();
     }
+  }
 
-    // extract glyph dictionary
-    uint16_t glyph_entry_size = 9;
-    uint32_t contour_data_offset = 8 + this->glyph_count * glyph_entry_size;
-    for(auto i = 0; i < this->glyph_count; i++) {
-      glyph_t g;
-      g.codepoint = ru16(ifs);
-      g.bounds.x  = rs8(ifs);
-      g.bounds.y  = rs8(ifs);
-      g.bounds.w  = ru8(ifs);
-      g.bounds.h  = ru8(ifs);
-      g.advance   = ru8(ifs);
-
-      if(ifs.fail()) {
-        // could not read glyph dictionary entry
-        return false;
-      }
+  // rasterises a glyph from its contours through pretty-poly
+  inline void draw_glyph(const text_metrics_t &tm, const glyph_t &glyph, fixed_point_t origin) {
+    // scale is a fixed point 16:16 value, our font data is already scaled to
+    // -128..127 so to get the pixel size we want we can just shift the
+    // users requested size up - nine bits for whole pixels, three for 26.6
+    fixed_t size = fixed_size(tm);
 
-      // allocate space for the contour data and read it from the font file
-      uint16_t contour_data_length = ru16(ifs);
+    bool quadratic = !glyph.controls.empty();
+    const vector<contour_t<int8_t>> &glyph_contours = tm.lod && !quadratic ?
+      tm.lod->contours(glyph, tm.size, settings::antialias) : glyph.contours_for(tm.size);
 
-      // remember where we are in the dictionary
-      int pos = ifs.tellg();  
+    int bx, by;
+    point_t<int> pixel(quantise_subpixel(origin.x, bx), quantise_subpixel(origin.y, by));
+    if(bx == 0 && by == 0 && !quadratic) {
+      draw_polygon<int8_t>(glyph_contours, pixel, size << 3);
+      return;
+    }
 
-      // read contour data
-      ifs.seekg(contour_data_offset, ios::beg);
-      while(true) {
-        // get number of points in contour
-        uint16_t count = ru16(ifs);
+    // pretty-poly only takes whole pixel origins so the subpixel offset is
+    // added to the points instead. they're scaled up by eight to give the
+    // offset some resolution which makes the matching scale the 26.6 size
+    int dx = (int64_t(bx) << 16) / (subpixel_bins * size);
+    int dy = (int64_t(by) << 16) / (subpixel_bins * size);
 
-        // if count is zero then this is the end of contour marker    
-        if(count == 0) {
-          break;
-        }
+    vector<point_t<int>> &points = scratch.points;
+    vector<contour_t<int>> &contours = scratch.contours;
+    grow(contours, glyph_contours.size());
 
-        // allocate space to store point data for contour and read
-        // from file
-        point_t<int8_t> *points = new point_t<int8_t>[count];
-        ifs.read((char *)points, count * 2);
+    if(quadratic) {
+      // flattened to suit the size so the number of edges grows with it,
+      // each point adds at most a sixteen segment curve
+      int64_t k = int64_t(tm.size) << settings::antialias;
+      vector<size_t> &ends = scratch.ends;
+      size_t bound = 0;
+      for(auto &contour : glyph_contours) {
+        bound += contour.count * 16 + 1;
+      }
+      grow(points, bound);
+      grow(ends, glyph_contours.size());
+      points.clear();
+      ends.clear();
+      for(size_t i = 0; i < glyph_contours.size(); i++) {
+        flatten_contour(glyph_contours[i], glyph.controls[i], k, point_t<int>(dx, dy), points);
+        ends.push_back(points.size());
+      }
 
-        g.contours.push_back({points, count});
-      }      
+      // points has finished growing so pointers into it are now stable
+      contours.clear();
+      size_t start = 0;
+      for(auto end : ends) {
+        contours.push_back({points.data() + start, unsigned(end - start)});
+        start = end;
+      }
 
-      // return back to position in dictionary
-      ifs.seekg(pos);
-      contour_data_offset += contour_data_length;
+      draw_polygon<int>(contours, pixel, size);
+      return;
+    }
 
-      if(ifs.fail()) {
-        // could not read glyph contour data
-        return false;
-      }
+    size_t count = 0;
+    for(auto &contour : glyph_contours) {
+      count += contour.count;
+    }
+    grow(points, count);
+    points.resize(count);
+    contours.clear();
 
-      this->glyphs[g.codepoint] = g;
+    point_t<int> *p = points.data();
+    for(auto &contour : glyph_contours) {
+      contours.push_back({p, contour.count});
+      for(unsigned i = 0; i < contour.count; i++, p++) {
+        p->x = contour.points[i].x * 8 + dx;
+        p->y = contour.points[i].y * 8 + dy;
+      }
     }
 
-    return true;
+    draw_polygon<int>(contours, pixel, size);
   }
 
-  bool face_t::load(string path) {
-    ifstream ifs(path, ios::binary);
-    if(ifs.fail()) {
-      // could not open file
-      return false;
-    }    
-    return load(ifs);
+  // where capture_tile copies tiles to while rasterising into a buffer
+  struct tile_capture_t {
+    uint8_t *data;
+    rect_t bounds;
+  };
+  inline tile_capture_t tile_capture;
+
+  inline void capture_tile(const tile_t &tile) {
+    for(auto y = 0; y < tile.bounds.h; y++) {
+      const uint8_t *src = tile.data + y * tile.stride;
+      uint8_t *dst = tile_capture.data + (tile.bounds.y - tile_capture.bounds.y + y) * tile_capture.bounds.w + tile.bounds.x - tile_capture.bounds.x;
+      for(auto x = 0; x < tile.bounds.w; x++) {
+        dst[x] = max(dst[x], src[x]);
+      }
+    }
+  }
+
+  // rasterises a glyph into a buffer of its own rather than through the
+  // tile callback, trimmed to the pixels it covers. bounds is left empty if
+  // it covers none
+  inline void rasterise_glyph(const text_metrics_t &tm, const glyph_t &glyph, fixed_point_t origin, rect_t &bounds, vector<uint8_t> &coverage) {
+    bounds = rect_t();
+    coverage.clear();
+
+    rect_t b = glyph_bounds(tm, glyph, origin);
+    if(b.empty()) {
+      return;
+    }
+
+    // pretty-poly keeps its settings in globals so they're swapped out
+    // for the duration
+    vector<uint8_t> &capture = scratch.capture;
+    grow(capture, b.w * b.h);
+    capture.assign(b.w * b.h, 0);
+    rect_t old_clip = settings::clip;
+    auto old_callback = settings::callback;
+    tile_capture = {capture.data(), b};
+    settings::clip = b;
+    settings::callback = capture_tile;
+    draw_glyph(tm, glyph, origin);
+    settings::clip = old_clip;
+    settings::callback = old_callback;
+
+    // trim away rows and columns with no coverage
+    int x1 = b.w, y1 = b.h, x2 = -1, y2 = -1;
+    for(auto y = 0; y < b.h; y++) {
+      for(auto x = 0; x < b.w; x++) {
+        if(capture[y * b.w + x]) {
+          x1 = min(x1, x); x2 = max(x2, x);
+          y1 = min(y1, y); y2 = max(y2, y);
+        }
+      }
+    }
+
+    if(x2 >= 0) {
+      bounds = rect_t(b.x + x1, b.y + y1, x2 - x1 + 1, y2 - y1 + 1);
+      grow(coverage, bounds.w * bounds.h);
+      for(auto y = y1; y <= y2; y++) {
+        coverage.insert(coverage.end(), capture.begin() + y * b.w + x1, capture.begin() + y * b.w + x2 + 1);
+      }
+    }
+  }
+
+  // passes the part of a coverage mask inside the clip rectangle to the
+  // tile callback as a view of data, which must hold bounds.h rows of stride
+  inline void render_mask(const uint8_t *data, int stride, rect_t bounds) {
+    rect_t clipped = bounds.intersection(settings::clip);
+    if(clipped.empty()) {
+      return;
+    }
+
+    tile_t tile;
+    tile.bounds = clipped;
+    tile.stride = stride;
+    // tiles are only ever read by the callback
+    tile.data = const_cast<uint8_t *>(data + (clipped.y - bounds.y) * stride + clipped.x - bounds.x);
+    settings::callback(tile);
+  }
+
+  // calls fn with the antialias level as a compile time constant, so that
+  // render paths specialised on it can be picked at runtime
+  template<typename F> void with_antialias(antialias_t antialias, F fn) {
+    switch(antialias) {
+      case X4:  fn(integral_constant<antialias_t, X4>()); break;
+      case X16: fn(integral_constant<antialias_t, X16>()); break;
+      default:  fn(integral_constant<antialias_t, NONE>()); break;
+    }
+  }
+
+  // scales the clipped part of a bitmap with BITS per pixel to coverage at
+  // antialias level A, both constant so there's no divide per pixel
+  template<antialias_t A, unsigned BITS> void expand_bitmap(const glyph_t::bitmap_t &bitmap, rect_t bounds, rect_t clipped, uint8_t *out) {
+    constexpr unsigned mask = (1 << BITS) - 1;
+    constexpr unsigned full = 1 << (A * 2);
+    for(auto y = 0; y < clipped.h; y++) {
+      unsigned bit = ((clipped.y - bounds.y + y) * bitmap.w + clipped.x - bounds.x) * BITS;
+      for(auto x = 0; x < clipped.w; x++, bit += BITS) {
+        unsigned v = (bitmap.data[bit >> 3] >> (8 - BITS - (bit & 7))) & mask;
+        *out++ = (v * full + mask / 2) / mask;
+      }
+    }
+  }
+
+  // passes a pre-rendered bitmap to the tile callback in place of drawing
+  // the contours, coverage is rescaled to the current antialiasing level so
+  // it looks no different to the callback
+  template<antialias_t A> void render_bitmap(const glyph_t::bitmap_t &bitmap, point_t<int> origin) {
+    rect_t bounds(origin.x + bitmap.x, origin.y + bitmap.y, bitmap.w, bitmap.h);
+    rect_t clipped = bounds.intersection(settings::clip);
+    if(clipped.empty()) {
+      return;
+    }
+
+    vector<uint8_t> &buffer = scratch.pixels;
+    grow(buffer, clipped.w * clipped.h);
+    buffer.resize(clipped.w * clipped.h);
+
+    // strikes are only ever read with 1, 2, 4, or 8 bits per pixel
+    switch(bitmap.bits) {
+      case 1:  expand_bitmap<A, 1>(bitmap, bounds, clipped, buffer.data()); break;
+      case 2:  expand_bitmap<A, 2>(bitmap, bounds, clipped, buffer.data()); break;
+      case 4:  expand_bitmap<A, 4>(bitmap, bounds, clipped, buffer.data()); break;
+      default: expand_bitmap<A, 8>(bitmap, bounds, clipped, buffer.data()); break;
+    }
+
+    tile_t tile;
+    tile.bounds = clipped;
+    tile.stride = clipped.w;
+    tile.data = buffer.data();
+    settings::callback(tile);
+  }
+
+  inline void render_bitmap(const glyph_t::bitmap_t &bitmap, point_t<int> origin) {
+    with_antialias(settings::antialias, [&](auto level) {render_bitmap<decltype(level)::value>(bitmap, origin);});
+  }
+
+  inline void render_glyph(const text_metrics_t &tm, const glyph_t &glyph, fixed_point_t origin) {
+    fixed_t size = fixed_size(tm);
+
+    // embedded bitmaps are blitted at the nearest whole pixel
+    const glyph_t::bitmap_t *bitmap = glyph.bitmap_for(size);
+    if(bitmap) {
+      render_bitmap(*bitmap, point_t<int>(fixed_round(origin.x), fixed_round(origin.y)));
+      return;
+    }
+
+    // glyphs of the cache's face come from the raster cache, or are
+    // rasterised into it the first time they're drawn at a size and
+    // subpixel position. others, such as those from a fallback face in a
+    // chain, are drawn directly
+    if(tm.raster && tm.raster->holds(glyph)) {
+      int bx, by;
+      point_t<int> pixel(quantise_subpixel(origin.x, bx), quantise_subpixel(origin.y, by));
+      int subpixel = by * subpixel_bins + bx;
+      const raster_cache_t::entry_t *e = tm.raster->find(glyph, size, settings::antialias, subpixel);
+      if(!e && tm.raster->record) {
+        // at full detail so that entries don't depend on tm.lod
+        text_metrics_t full = tm;
+        full.lod = nullptr;
+        rect_t bounds;
+        rasterise_glyph(full, glyph, fixed_point((bx << 6) / subpixel_bins, (by << 6) / subpixel_bins), bounds, scratch.mask);
+        e = tm.raster->add(glyph, size, settings::antialias, subpixel, bounds, scratch.mask);
+      }
+
+      if(e) {
+        rect_t b = e->bounds;
+        render_mask(e->data, b.w, rect_t(pixel.x + b.x, pixel.y + b.y, b.w, b.h));
+        return;
+      }
+    }
+
+    draw_glyph(tm, glyph, origin);
+  }
+
+  inline void render_glyph(const text_metrics_t &tm, const glyph_t &glyph, point_t<int> origin) {
+    render_glyph(tm, glyph, fixed_point_t(origin));
+  }
+
+  // grows the scratch buffers enough to draw any glyph of a face at sizes
+  // up to max_size pixels without allocating, returns the bytes reserved
+  inline size_t reserve_scratch(face_t &face, int max_size) {
+    text_metrics_t tm(face, max_size);
+    size_t points = 0, contours = 0, area = 0;
+    for(auto &[codepoint, glyph] : face.glyphs) {
+      bool quadratic = !glyph.controls.empty();
+      for(size_t level = 0; level <= glyph.details.size(); level++) {
+        auto &level_contours = level < glyph.details.size() ? glyph.details[level].contours : glyph.contours;
+        size_t count = 0;
+        for(auto &contour : level_contours) {
+          count += quadratic ? contour.count * 16 + 1 : contour.count;
+        }
+        points = max(points, count);
+        contours = max(contours, level_contours.size());
+      }
+
+      // the glyph bounds at a subpixel offset are at most a pixel bigger
+      rect_t b = glyph_bounds(tm, glyph, fixed_point_t());
+      area = max(area, size_t(b.w + 1) * (b.h + 1));
+      for(auto &bitmap : glyph.bitmaps) {
+        area = max(area, size_t(bitmap.w) * bitmap.h);
+      }
+    }
+
+    grow(scratch.points, points);
+    grow(scratch.contours, contours);
+    grow(scratch.ends, contours);
+    grow(scratch.capture, area);
+    grow(scratch.mask, area);
+    grow(scratch.pixels, area);
+    return scratch.points.capacity() * sizeof(point_t<int>) + scratch.contours.capacity() * sizeof(contour_t<int>) +
+      scratch.ends.capacity() * sizeof(size_t) + scratch.capture.capacity() + scratch.mask.capacity() + scratch.pixels.capacity();
+  }
+
+  inline void render_character(text_metrics_t &tm, uint16_t codepoint, fixed_point_t origin) {
+    const glyph_t *glyph = find_glyph(tm, codepoint);
+    if(glyph) {
+      render_glyph(tm, *glyph, origin);
+    }
+  }
+
+  inline void render_character(text_metrics_t &tm, uint16_t codepoint, point_t<int> origin) {
+    render_character(tm, codepoint, fixed_point_t(origin));
+  }
+
+  inline void render_character(const static_face_t &face, int size, uint16_t codepoint, point_t<int> origin) {
+    const static_glyph_t *glyph = face.find(codepoint);
+    if(!glyph) {
+      return;
+    }
+
+    // contour points are stored as signed byte pairs which matches the
+    // layout of point_t<int8_t>, the list is reused between calls so only
+    // the first few characters drawn ever allocate
+    vector<contour_t<int8_t>> &contours = scratch.static_contours;
+    grow(contours, glyph->contour_count);
+    contours.clear();
+    for(auto i = 0; i < glyph->contour_count; i++) {
+      const static_contour_t &c = face.contours[glyph->contour + i];
+      contours.push_back({(point_t<int8_t> *)(face.points + c.point * 2), c.count});
+    }
+
+    draw_polygon<int8_t>(contours, origin, size << 9);
+  }
+
+  // renders the byte range [start, end) of text on a single line with the
+  // baseline of the first character at origin
+  inline void render_text(text_metrics_t &tm, const string &text, size_t start, size_t end, fixed_point_t origin) {
+    while(start < end) {
+      uint16_t codepoint = next_codepoint(text, start);
+      render_character(tm, codepoint, origin);
+      origin.x += character_advance(tm, codepoint);
+    }
+  }
+
+  inline void render_text(text_metrics_t &tm, const string &text, size_t start, size_t end, point_t<int> origin) {
+    render_text(tm, text, start, end, fixed_point_t(origin));
+  }
+
+  // renders a shaped run with the baseline of its first character at origin
+  inline void render_run(const text_metrics_t &tm, const run_t &run, fixed_point_t origin) {
+    for(auto &g : run.glyphs) {
+      render_glyph(tm, *g.glyph, fixed_point(origin.x + g.x, origin.y));
+    }
+  }
+
+  inline void render_run(const text_metrics_t &tm, const run_t &run, point_t<int> origin) {
+    render_run(tm, run, fixed_point_t(origin));
+  }
+
+/*
+  inline void render(const text_metrics_t &tm, rect_t bounds) {
+  }
+
+  inline void render(const text_metrics_t &tm, point_t point) {
+  }
+*/
+
+  /*
+    document functions
+  */
+
+  inline void document_t::set_text(const string &text) {
+    this->text = text;
+    layout();
+  }
+
+  // breaks the whole text into lines no wider than the document, preferring
+  // to break at spaces - this is the only pass over the full text, scrolling
+  // and rendering afterwards only touch the lines in view
+  inline void document_t::layout() {
+    lines.clear();
+
+    size_t start = 0, i = 0;
+    size_t break_at = string::npos; // last space seen on the current line
+    fixed_t line_width = 0, break_width = 0;
+    while(i < text.size()) {
+      size_t pos = i;
+      uint16_t codepoint = next_codepoint(text, i);
+
+      if(codepoint == '\n') {
+        lines.push_back({(uint32_t)start, (uint32_t)(pos - start), fixed_round(line_width)});
+        start = i;
+        break_at = string::npos;
+        line_width = 0;
+        continue;
+      }
+
+      fixed_t a = character_advance(tm, codepoint);
+      if(line_width + a > to_fixed(width) && pos > start) {
+        if(break_at != string::npos) {
+          // wrap at the last space, which is dropped from both lines
+          lines.push_back({(uint32_t)start, (uint32_t)(break_at - start), fixed_round(break_width)});
+          line_width -= break_width + character_advance(tm, ' ');
+          start = break_at + 1;
+        } else {
+          // no space on this line so break mid word
+          lines.push_back({(uint32_t)start, (uint32_t)(pos - start), fixed_round(line_width)});
+          line_width = 0;
+          start = pos;
+        }
+        break_at = string::npos;
+      }
+
+      if(codepoint == ' ') {
+        break_at = pos;
+        break_width = line_width;
+      }
+      line_width += a;
+    }
+
+    lines.push_back({(uint32_t)start, (uint32_t)(text.size() - start), fixed_round(line_width)});
+  }
+
+  inline int document_t::height() const {
+    return lines.size() * line_pitch(tm);
+  }
+
+  inline size_t document_t::first_visible_line() const {
+    int pitch = line_pitch(tm);
+    return pitch > 0 ? min<size_t>(tm.scroll / pitch, lines.size()) : 0;
+  }
+
+  // renders the lines that intersect the viewport, scrolled by tm.scroll,
+  // drawing is clipped to the viewport so partially visible lines don't
+  // spill outside of it
+  inline void document_t::render(rect_t viewport) {
+    rect_t clip = settings::clip;
+    settings::clip = clip.intersection(viewport);
+
+    int pitch = line_pitch(tm);
+    int ascent = line_ascent(tm);
+    for(size_t i = first_visible_line(); i < lines.size(); i++) {
+      int y = viewport.y + (int)(i * pitch) - (int)tm.scroll;
+      if(y >= viewport.y + viewport.h) {
+        break;
+      }
+
+      const line_t &line = lines[i];
+      int x = viewport.x;
+      if(tm.align & center) {x += (width - line.width) / 2;}
+      if(tm.align & right)  {x += width - line.width;}
+
+      render_text(tm, text, line.offset, line.offset + line.length, point_t<int>(x, y + ascent));
+    }
+
+    settings::clip = clip;
+  }
+
+
+  /*
+    paragraph functions
+  */
+
+  inline void paragraph_t::set_text(const string &text) {
+    codepoints.clear();
+    for(size_t i = 0; i < text.size();) {
+      codepoints.push_back(next_codepoint(text, i));
+    }
+    layout();
+  }
+
+  // rebuilds the running widths and line breaks from scratch, needed after
+  // changing the text metrics or width
+  inline void paragraph_t::layout() {
+    prefix.assign(codepoints.size() + 1, 0);
+    for(size_t i = 0; i < codepoints.size(); i++) {
+      prefix[i + 1] = prefix[i] + character_advance(tm, codepoints[i]);
+    }
+    breaks.assign(1, 0);
+    rewrap(0, 0, {});
+  }
+
+  inline void paragraph_t::insert(size_t index, const string &text) {
+    index = min(index, codepoints.size());
+
+    vector<uint16_t> inserted;
+    for(size_t i = 0; i < text.size();) {
+      inserted.push_back(next_codepoint(text, i));
+    }
+    size_t count = inserted.size();
+
+    // line containing the edit and the old line starts after it, moved
+    // along by the inserted characters
+    size_t line = line_of(index);
+    vector<uint32_t> tail(breaks.begin() + line + 1, breaks.end());
+    for(auto &b : tail) {
+      b += count;
+    }
+
+    codepoints.insert(codepoints.begin() + index, inserted.begin(), inserted.end());
+
+    // splice in running widths for the new characters and shift the rest
+    fixed_t base = prefix[index];
+    prefix.insert(prefix.begin() + index + 1, count, 0);
+    for(size_t i = 0; i < count; i++) {
+      prefix[index + i + 1] = prefix[index + i] + character_advance(tm, inserted[i]);
+    }
+    fixed_t delta = prefix[index + count] - base;
+    for(size_t i = index + count + 1; i < prefix.size(); i++) {
+      prefix[i] += delta;
+    }
+
+    rewrap(index + count, line, tail);
+  }
+
+  inline void paragraph_t::erase(size_t index, size_t count) {
+    index = min(index, codepoints.size());
+    count = min(count, codepoints.size() - index);
+
+    // old line starts after the edit, those inside the erased range vanish
+    size_t line = line_of(index);
+    vector<uint32_t> tail;
+    for(size_t i = line + 1; i < breaks.size(); i++) {
+      if(breaks[i] >= index + count) {
+        tail.push_back(breaks[i] - count);
+      }
+    }
+
+    fixed_t delta = prefix[index + count] - prefix[index];
+    codepoints.erase(codepoints.begin() + index, codepoints.begin() + index + count);
+    prefix.erase(prefix.begin() + index + 1, prefix.begin() + index + count + 1);
+    for(size_t i = index + 1; i < prefix.size(); i++) {
+      prefix[i] -= delta;
+    }
+
+    rewrap(index, line, tail);
+  }
+
+  // returns the index of the first character of the line after the one
+  // starting at start. spaces are allowed to hang past the right edge and
+  // a line only breaks mid word if the word is wider than the paragraph
+  inline size_t paragraph_t::wrap_line(size_t start) const {
+    size_t last_break = 0;
+    for(size_t i = start; i < codepoints.size(); i++) {
+      uint16_t codepoint = codepoints[i];
+      if(codepoint == '\n') {
+        return i + 1;
+      }
+
+      if(codepoint == ' ') {
+        last_break = i + 1;
+        continue;
+      }
+
+      if(i > start && prefix[i + 1] - prefix[start] > to_fixed(width)) {
+        return last_break ? last_break : i;
+      }
+    }
+    return codepoints.size();
+  }
+
+  // re-wraps from the line before the edited one (a shorter word may now
+  // fit at the end of it) until a line starts at or after end, the end of
+  // the edited text, at the same place as an old line did, then reuses the
+  // old tail
+  inline void paragraph_t::rewrap(size_t end, size_t line, vector<uint32_t> tail) {
+    line = line > 0 ? line - 1 : 0;
+    breaks.resize(line + 1);
+
+    size_t n = codepoints.size();
+    size_t start = breaks[line];
+    auto old = tail.begin();
+    while(true) {
+      start = wrap_line(start);
+      if(start == n && (n == 0 || codepoints[n - 1] != '\n')) {
+        // end of text without a trailing line break
+        break;
+      }
+
+      while(old != tail.end() && *old < start) {
+        old++;
+      }
+
+      if(start >= end && old != tail.end() && *old == start) {
+        // breaks realigned with the previous layout
+        breaks.insert(breaks.end(), old, tail.end());
+        break;
+      }
+
+      breaks.push_back(start);
+      if(start == n) {
+        break;
+      }
+    }
+  }
+
+  // index of the line containing the character at index
+  inline size_t paragraph_t::line_of(size_t index) const {
+    return upper_bound(breaks.begin(), breaks.end(), index) - breaks.begin() - 1;
+  }
+
+  // width in pixels of a line excluding trailing spaces or line break
+  inline int paragraph_t::line_width(size_t line) const {
+    size_t start = breaks[line];
+    size_t end = line + 1 < breaks.size() ? breaks[line + 1] : codepoints.size();
+    while(end > start && (codepoints[end - 1] == ' ' || codepoints[end - 1] == '\n')) {
+      end--;
+    }
+    return fixed_round(prefix[end] - prefix[start]);
+  }
+
+  // position of the caret before the character at index, relative to the
+  // top left of the paragraph
+  inline point_t<int> paragraph_t::caret(size_t index) const {
+    size_t line = line_of(index);
+    return point_t<int>(fixed_round(prefix[index] - prefix[breaks[line]]), line * line_pitch(tm));
+  }
+
+  inline void paragraph_t::render(point_t<int> origin) {
+    int pitch = line_pitch(tm);
+    int ascent = line_ascent(tm);
+    for(size_t line = 0; line < breaks.size(); line++) {
+      size_t start = breaks[line];
+      size_t end = line + 1 < breaks.size() ? breaks[line + 1] : codepoints.size();
+
+      int x = origin.x;
+      if(tm.align & center) {x += (width - line_width(line)) / 2;}
+      if(tm.align & right)  {x += width - line_width(line);}
+
+      int y = origin.y + line * pitch + ascent;
+      for(size_t i = start; i < end; i++) {
+        render_character(tm, codepoints[i], fixed_point(to_fixed(x) + prefix[i] - prefix[start], to_fixed(y)));
+      }
+    }
+  }
+
+
+  /*
+    label functions
+  */
+
+  // lays out the new text and compares it cell by cell with what was drawn
+  // last time, a cell is dirty if its character or position changed and
+  // neighbouring dirty cells are merged into a single rectangle
+  inline vector<rect_t> label_t::update(const string &text) {
+    next.clear();
+    fixed_point_t caret(origin);
+    for(size_t i = 0; i < text.size();) {
+      uint16_t codepoint = next_codepoint(text, i);
+      append(next, {codepoint, caret, character_bounds(tm, codepoint, caret)});
+      caret.x += character_advance(tm, codepoint);
+    }
+
+    vector<rect_t> dirty;
+    bool merging = false;
+    for(size_t i = 0; i < max(cells.size(), next.size()); i++) {
+      const cell_t *a = i < cells.size() ? &cells[i] : nullptr;
+      const cell_t *b = i < next.size() ? &next[i] : nullptr;
+      if(a && b && a->codepoint == b->codepoint && a->origin == b->origin) {
+        merging = false;
+        continue;
+      }
+
+      rect_t changed = merge(a ? a->bounds : rect_t(), b ? b->bounds : rect_t());
+      if(changed.empty()) {
+        // e.g. one space replaced by another
+        continue;
+      }
+
+      if(merging) {
+        dirty.back() = merge(dirty.back(), changed);
+      } else {
+        append(dirty, changed);
+      }
+      merging = true;
+    }
+
+    cells.swap(next);
+    return dirty;
+  }
+
+  // renders every cell that overlaps area, clipped to it, so that an
+  // unchanged neighbour whose glyph reaches into a dirty rectangle is
+  // redrawn there too
+  inline void label_t::render(rect_t area) {
+    rect_t clip = settings::clip;
+    settings::clip = clip.intersection(area);
+    if(!settings::clip.empty()) {
+      for(auto &cell : cells) {
+        if(!cell.bounds.empty() && !cell.bounds.intersection(area).empty()) {
+          render_character(tm, cell.codepoint, cell.origin);
+        }
+      }
+    }
+    settings::clip = clip;
+  }
+
+  inline void label_t::render() {
+    for(auto &cell : cells) {
+      render_character(tm, cell.codepoint, cell.origin);
+    }
+  }
+
+
+  /*
+    face chain functions
+  */
+
+  inline const glyph_t *face_chain_t::find(uint16_t codepoint) const {
+    // entries are 0 for unresolved, 255 for missing from every face,
+    // otherwise the index of the face plus one
+    auto &page = pages[codepoint >> 8];
+    if(!page) {
+      check_heap();
+      page.reset(new uint8_t[256]());
+    }
+
+    uint8_t &entry = page[codepoint & 0xff];
+    if(entry == 0) {
+      entry = 255;
+      for(size_t i = 0; i < faces.size() && i < 254; i++) {
+        if(faces[i]->find(codepoint)) {
+          entry = i + 1;
+          break;
+        }
+      }
+    }
+
+    return entry == 255 ? nullptr : faces[entry - 1]->find(codepoint);
+  }
+
+
+  /*
+    level of detail functions
+  */
+
+  // marks the points of a closed contour that must be kept so that no
+  // dropped point is further than the tolerance from the simplified outline
+  // (douglas-peucker). the tolerance is 64 / k font units, compared with
+  // squared integer distances to avoid any division
+  inline void simplify_contour(const contour_t<int8_t> &contour, int64_t k, vector<bool> &keep) {
+    const point_t<int8_t> *p = contour.points;
+    unsigned n = contour.count;
+    keep.assign(n, false);
+
+    // anchor on the first point and the point furthest from it
+    unsigned far = 0;
+    int64_t far_d = -1;
+    for(unsigned i = 1; i < n; i++) {
+      int64_t dx = p[i].x - p[0].x, dy = p[i].y - p[0].y;
+      if(dx * dx + dy * dy > far_d) {far_d = dx * dx + dy * dy; far = i;}
+    }
+    keep[0] = keep[far] = true;
+
+    // spans are [a, b] with indices wrapping around the end of the contour
+    vector<pair<unsigned, unsigned>> spans = {{0, far}, {far, n}};
+    while(!spans.empty()) {
+      auto [a, b] = spans.back();
+      spans.pop_back();
+
+      const point_t<int8_t> &pa = p[a], &pb = p[b % n];
+      int64_t ex = pb.x - pa.x, ey = pb.y - pa.y;
+      int64_t len = ex * ex + ey * ey;
+
+      unsigned worst = 0;
+      int64_t worst_d = 0;
+      for(unsigned i = a + 1; i < b; i++) {
+        int64_t dx = p[i].x - pa.x, dy = p[i].y - pa.y;
+        // squared distance from the line scaled by len, or to pa if the
+        // span starts and ends on the same point
+        int64_t d = len ? (ex * dy - ey * dx) * (ex * dy - ey * dx) : dx * dx + dy * dy;
+        if(d > worst_d) {worst_d = d; worst = i;}
+      }
+
+      // keep the worst point if its distance exceeds 64 / k
+      if(worst && worst_d * k * k > 4096 * (len ? len : 1)) {
+        keep[worst] = true;
+        spans.push_back({a, worst});
+        spans.push_back({worst, b});
+      }
+    }
+  }
+
+  inline const vector<contour_t<int8_t>> &lod_cache_t::contours(const glyph_t &glyph, int size, antialias_t antialias) {
+    // samples are 1 / (1 << antialias) pixels apart and a font unit is
+    // size / 128 pixels, half a sample is 64 / (size << antialias) units.
+    // once that falls to a unit or less (coordinates are whole units)
+    // there's nothing to gain. quadratic contours are already flattened to
+    // suit the size when drawn
+    int64_t k = int64_t(size) << antialias;
+    if(k >= 64 || !glyph.controls.empty()) {
+      return glyph.contours_for(size);
+    }
+
+    auto key = make_tuple(&glyph, size, (int)antialias);
+    auto it = entries.find(key);
+    if(it != entries.end()) {
+      return it->second.contours;
+    }
+
+    check_heap();
+    entry_t &e = entries[key];
+    vector<bool> keep;
+    vector<pair<size_t, unsigned>> ranges; // start in points and count
+    for(auto &contour : glyph.contours_for(size)) {
+      simplify_contour(contour, k, keep);
+      unsigned kept = count(keep.begin(), keep.end(), true);
+      if(kept < 3) {
+        // collapsed, keep the original rather than lose e.g. a dot
+        keep.assign(contour.count, true);
+        kept = contour.count;
+      }
+
+      ranges.push_back({e.points.size(), kept});
+      for(unsigned i = 0; i < contour.count; i++) {
+        if(keep[i]) {
+          e.points.push_back(contour.points[i]);
+        }
+      }
+    }
+
+    // points are complete so pointers into them are now stable
+    for(auto &r : ranges) {
+      e.contours.push_back({e.points.data() + r.first, r.second});
+    }
+    return e.contours;
+  }
+
+
+  /*
+    run cache functions
+  */
+
+  // returns the cached run for text if there is one, otherwise decodes and
+  // positions it - evicting the least recently used run if the cache is full
+  inline const run_t &run_cache_t::shape(const text_metrics_t &tm, const string &text) {
+    key_t key(tm.chain ? (const void *)tm.chain : &tm.face, fixed_size(tm), tm.letting_spacing, tm.word_spacing, hash<string>{}(text));
+
+    clock++;
+    auto it = runs.find(key);
+    if(it != runs.end() && it->second.text == text) {
+      hits++;
+      it->second.used = clock;
+      return it->second;
+    }
+
+    misses++;
+    check_heap();
+    if(it == runs.end() && runs.size() >= capacity) {
+      runs.erase(min_element(runs.begin(), runs.end(), [](auto &a, auto &b) {
+        return a.second.used < b.second.used;
+      }));
+    }
+
+    // a hash collision simply replaces the other run
+    run_t &run = runs[key];
+    run.text = text;
+    run.glyphs.clear();
+    run.width = 0;
+    run.used = clock;
+    for(size_t i = 0; i < text.size();) {
+      uint16_t codepoint = next_codepoint(text, i);
+      const glyph_t *glyph = find_glyph(tm, codepoint);
+      if(glyph) {
+        run.glyphs.push_back({glyph, codepoint, run.width});
+      }
+      run.width += character_advance(tm, codepoint);
+    }
+
+    return run;
+  }
+
+
+  /*
+    atlas functions
+  */
+
+  // skyline packing, the top edge of everything placed so far is kept as a
+  // list of horizontal segments and each rectangle goes wherever its top
+  // would be lowest. placing the tallest first keeps the skyline flat.
+  // returns the height used or -1 if a rectangle is wider than width
+  inline int pack_skyline(const vector<rect_t> &rects, int width, vector<point_t<int>> &positions) {
+    struct segment_t {int x, y, w;};
+    vector<segment_t> skyline = {{0, 0, width}};
+
+    vector<size_t> order(rects.size());
+    for(size_t i = 0; i < order.size(); i++) {order[i] = i;}
+    sort(order.begin(), order.end(), [&rects](size_t a, size_t b) {
+      return rects[a].h != rects[b].h ? rects[a].h > rects[b].h : rects[a].w > rects[b].w;
+    });
+
+    int height = 0;
+    positions.assign(rects.size(), point_t<int>(0, 0));
+    for(auto i : order) {
+      const rect_t &r = rects[i];
+      if(r.w > width) {
+        return -1;
+      }
+
+      // find the segment to start at which gives the lowest top, then the
+      // leftmost of those
+      size_t best = skyline.size();
+      int best_y = 0;
+      for(size_t s = 0; s < skyline.size(); s++) {
+        if(skyline[s].x + r.w > width) {
+          break;
+        }
+
+        int y = 0, remaining = r.w;
+        for(size_t t = s; remaining > 0; t++) {
+          y = max(y, skyline[t].y);
+          remaining -= skyline[t].w;
+        }
+
+        if(best == skyline.size() || y < best_y) {
+          best = s;
+          best_y = y;
+        }
+      }
+
+      int x = skyline[best].x;
+      positions[i] = point_t<int>(x, best_y);
+      height = max(height, best_y + r.h);
+
+      // raise the skyline under the rectangle, trimming any segment it
+      // partly covers, then join neighbours at the same height
+      vector<segment_t> raised;
+      for(auto &segment : skyline) {
+        int left = segment.x, right = segment.x + segment.w;
+        if(right <= x || left >= x + r.w) {
+          raised.push_back(segment);
+          continue;
+        }
+        if(left < x) {
+          raised.push_back({left, segment.y, x - left});
+        }
+        if(left <= x) {
+          raised.push_back({x, best_y + r.h, r.w});
+        }
+        if(right > x + r.w) {
+          raised.push_back({x + r.w, segment.y, right - x - r.w});
+        }
+      }
+
+      skyline.clear();
+      for(auto &segment : raised) {
+        if(!skyline.empty() && skyline.back().y == segment.y) {
+          skyline.back().w += segment.w;
+        } else {
+          skyline.push_back(segment);
+        }
+      }
+    }
+
+    return height;
+  }
+
+  inline bool atlas_t::build(face_t &face, const vector<int> &sizes, antialias_t antialias, int width) {
+    struct job_t {
+      int size;
+      uint16_t codepoint;
+      rect_t bounds;                  // trimmed, relative to the origin
+      fixed_t advance;
+      vector<uint8_t> coverage;
+    };
+
+    // pretty-poly keeps its settings and working buffers in globals so the
+    // glyphs are rasterised one at a time, each into its own buffer
+    antialias_t old_antialias = settings::antialias;
+    settings::antialias = antialias;
+
+    vector<job_t> jobs;
+    for(auto size : sizes) {
+      text_metrics_t tm(face, size);
+      for(auto &[codepoint, glyph] : face.glyphs) {
+        job_t job = {size, codepoint, rect_t(), character_advance(tm, codepoint), {}};
+        rasterise_glyph(tm, glyph, fixed_point_t(), job.bounds, job.coverage);
+        jobs.push_back(move(job));
+      }
+    }
+
+    settings::antialias = old_antialias;
+
+    // a pixel of padding to the right and below each glyph stops filtered
+    // or scaled lookups picking up coverage from a neighbour
+    vector<rect_t> rects;
+    for(auto &job : jobs) {
+      rects.push_back(rect_t(0, 0, job.bounds.w ? job.bounds.w + 1 : 0, job.bounds.h ? job.bounds.h + 1 : 0));
+    }
+
+    vector<point_t<int>> positions;
+    int packed_height = pack_skyline(rects, width, positions);
+    if(packed_height < 0) {
+      return false;
+    }
+
+    this->width = width;
+    this->height = packed_height;
+    this->antialias = antialias;
+    this->pixels.assign(width * packed_height, 0);
+    this->entries.clear();
+    this->used = 0;
+
+    for(size_t i = 0; i < jobs.size(); i++) {
+      job_t &job = jobs[i];
+      entry_t e = {rect_t(positions[i].x, positions[i].y, job.bounds.w, job.bounds.h), int16_t(job.bounds.x), int16_t(job.bounds.y), job.advance};
+      this->entries[make_pair(job.size, job.codepoint)] = e;
+      this->used += job.bounds.w * job.bounds.h;
+
+      for(auto y = 0; y < job.bounds.h; y++) {
+        memcpy(&this->pixels[(e.uv.y + y) * width + e.uv.x], &job.coverage[y * job.bounds.w], job.bounds.w);
+      }
+    }
+
+    return true;
+  }
+
+  // draws a glyph from the atlas, the tile passed to the callback is a view
+  // straight into the atlas pixels
+  inline void render_character(const atlas_t &atlas, int size, uint16_t codepoint, point_t<int> origin) {
+    const atlas_t::entry_t *e = atlas.find(size, codepoint);
+    if(!e || e->uv.empty()) {
+      return;
+    }
+
+    rect_t bounds(origin.x + e->x, origin.y + e->y, e->uv.w, e->uv.h);
+    render_mask(&atlas.pixels[e->uv.y * atlas.width + e->uv.x], atlas.width, bounds);
+  }
+
+  // draws text on a single line with the baseline of the first character at
+  // origin, glyphs are placed at the nearest whole pixel
+  inline void render_text(const atlas_t &atlas, int size, string_view text, point_t<int> origin) {
+    fixed_t x = to_fixed(origin.x);
+    size_t i = 0;
+    while(i < text.size()) {
+      uint16_t codepoint = next_codepoint(text, i);
+      const atlas_t::entry_t *e = atlas.find(size, codepoint);
+      if(e) {
+        render_character(atlas, size, codepoint, point_t<int>(fixed_round(x), origin.y));
+        x += e->advance;
+      }
+    }
+  }
+
+
+  /*
+    signed distance field functions
+  */
+
+  inline bool sdf_t::build(const glyph_t &glyph, int resolution, int spread) {
+    this->resolution = resolution;
+    this->spread = spread;
+    this->field.clear();
+    this->w = this->h = 0;
+    if(resolution <= 0 || spread <= 0) {
+      return false;
+    }
+
+    // outline edges in eighths of a font unit, quadratic contours are
+    // flattened finely enough for a field many times this resolution
+    vector<point_t<int>> points;
+    vector<size_t> ends;
+    for(size_t i = 0; i < glyph.contours.size(); i++) {
+      const contour_t<int8_t> &contour = glyph.contours[i];
+      if(!glyph.controls.empty()) {
+        flatten_contour(contour, glyph.controls[i], int64_t(resolution) << 4, point_t<int>(0, 0), points);
+      } else {
+        for(unsigned j = 0; j < contour.count; j++) {
+          points.push_back(point_t<int>(contour.points[j].x * 8, contour.points[j].y * 8));
+        }
+      }
+      ends.push_back(points.size());
+    }
+
+    // the field covers the glyph bounds (stored y up) plus the spread
+    auto texel_floor = [resolution](int units) {return int(floor(units * resolution / 128.0f));};
+    auto texel_ceil = [resolution](int units) {return int(ceil(units * resolution / 128.0f));};
+    this->x = texel_floor(glyph.bounds.x) - spread;
+    this->y = texel_floor(-(glyph.bounds.y + glyph.bounds.h)) - spread;
+    this->w = texel_ceil(glyph.bounds.x + glyph.bounds.w) + spread - this->x;
+    this->h = texel_ceil(-glyph.bounds.y) + spread - this->y;
+    this->field.assign(this->w * this->h, 0);
+
+    // distance from texel centres to every edge and the winding number
+    // around them for the sign, outlines are filled non-zero
+    float texel = 1024.0f / resolution;   // eighths of a unit per texel
+    for(auto ty = 0; ty < this->h; ty++) {
+      for(auto tx = 0; tx < this->w; tx++) {
+        float px = (this->x + tx + 0.5f) * texel, py = (this->y + ty + 0.5f) * texel;
+        float nearest = 1e30f;
+        int winding = 0;
+
+        size_t start = 0;
+        for(auto end : ends) {
+          for(size_t i = start; i < end; i++) {
+            const point_t<int> &a = points[i];
+            const point_t<int> &b = points[i + 1 < end ? i + 1 : start];
+
+            float ex = b.x - a.x, ey = b.y - a.y;
+            float len = ex * ex + ey * ey;
+            float t = len > 0.0f ? ((px - a.x) * ex + (py - a.y) * ey) / len : 0.0f;
+            t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+            float dx = a.x + ex * t - px, dy = a.y + ey * t - py;
+            nearest = min(nearest, dx * dx + dy * dy);
+
+            // edges crossing a ray to the right count by their direction
+            float cross = ex * (py - a.y) - ey * (px - a.x);
+            if(a.y <= py && b.y > py && cross > 0.0f) {winding++;}
+            if(a.y > py && b.y <= py && cross < 0.0f) {winding--;}
+          }
+          start = end;
+        }
+
+        float distance = sqrtf(nearest) / texel;
+        if(winding == 0) {
+          distance = -distance;
+        }
+        int v = 128 + int(lroundf(distance * 127.0f / spread));
+        this->field[ty * this->w + tx] = v < 0 ? 0 : (v > 255 ? 255 : v);
+      }
+    }
+
+    return true;
+  }
+
+  inline const sdf_t &sdf_cache_t::field(const glyph_t &glyph) {
+    auto it = fields.find(&glyph);
+    if(it == fields.end()) {
+      check_heap();
+      it = fields.emplace(&glyph, sdf_t()).first;
+      it->second.build(glyph, resolution, spread);
+    }
+    return it->second;
+  }
+
+  // draws a glyph from its distance field at a 26.6 size, coverage comes
+  // from the distance to the edge at each pixel centre so it's antialiased
+  // at any size. offset moves the edge outwards (or inwards if negative) by
+  // that many 26.6 pixels, which with a different origin makes an outline
+  // or drop shadow of the same glyph
+  template<antialias_t A> void render_sdf(const sdf_t &sdf, fixed_t size, fixed_point_t origin, fixed_t offset = 0) {
+    if(sdf.field.empty() || size <= 0) {
+      return;
+    }
+
+    // field texels per pixel and the field's area on screen, 26.6
+    int64_t step = (int64_t(sdf.resolution) << 22) / size;    // 16.16
+    fixed_t left = origin.x + fixed_t(int64_t(sdf.x) * size / sdf.resolution);
+    fixed_t top = origin.y + fixed_t(int64_t(sdf.y) * size / sdf.resolution);
+    fixed_t right = origin.x + fixed_t(int64_t(sdf.x + sdf.w) * size / sdf.resolution);
+    fixed_t bottom = origin.y + fixed_t(int64_t(sdf.y + sdf.h) * size / sdf.resolution);
+
+    rect_t bounds(fixed_floor(left), fixed_floor(top), fixed_ceil(right) - fixed_floor(left), fixed_ceil(bottom) - fixed_floor(top));
+    rect_t clipped = bounds.intersection(settings::clip);
+    if(clipped.empty()) {
+      return;
+    }
+
+    vector<uint8_t> &buffer = scratch.pixels;
+    grow(buffer, clipped.w * clipped.h);
+    buffer.resize(clipped.w * clipped.h);
+
+    // a field value is (distance * 127 / spread) texels from the edge at
+    // 128, in pixels that's scaled by size / resolution. coverage is then
+    // half a pixel either side of the edge, worked in 1/256ths of a pixel
+    int64_t scale = (int64_t(sdf.spread) * size) << 2;
+    int64_t divisor = 127 * sdf.resolution;
+    constexpr int full = 1 << (A * 2);
+    auto sample = [&sdf](int tx, int ty) -> int {
+      if(tx < 0 || ty < 0 || tx >= sdf.w || ty >= sdf.h) {return 0;}
+      return sdf.field[ty * sdf.w + tx];
+    };
+
+    uint8_t *out = buffer.data();
+    for(auto y = 0; y < clipped.h; y++) {
+      // pixel centre in texels relative to the field, 16.16
+      int64_t fy = (int64_t(to_fixed(clipped.y + y) + 32 - origin.y) * (int64_t(sdf.resolution) << 16) / size) - (int64_t(sdf.y) << 16) - 32768;
+      int ty = int(fy >> 16), wy = int(fy & 0xffff) >> 8;
+      int64_t fx = (int64_t(to_fixed(clipped.x) + 32 - origin.x) * (int64_t(sdf.resolution) << 16) / size) - (int64_t(sdf.x) << 16) - 32768;
+      for(auto x = 0; x < clipped.w; x++, fx += step) {
+        int tx = int(fx >> 16), wx = int(fx & 0xffff) >> 8;
+
+        // bilinear sample with 8-bit weights
+        int top_row = sample(tx, ty) * (256 - wx) + sample(tx + 1, ty) * wx;
+        int bottom_row = sample(tx, ty + 1) * (256 - wx) + sample(tx + 1, ty + 1) * wx;
+        int v = (top_row * (256 - wy) + bottom_row * wy + 32768) >> 16;
+
+        int64_t distance = (v - 128) * scale / divisor + (offset << 2) + 128;
+        distance = distance < 0 ? 0 : (distance > 256 ? 256 : distance);
+        *out++ = (distance * full + 128) >> 8;
+      }
+    }
+
+    tile_t tile;
+    tile.bounds = clipped;
+    tile.stride = clipped.w;
+    tile.data = buffer.data();
+    settings::callback(tile);
+  }
+
+  inline void render_sdf(const sdf_t &sdf, fixed_t size, fixed_point_t origin, fixed_t offset = 0) {
+    with_antialias(settings::antialias, [&](auto level) {render_sdf<decltype(level)::value>(sdf, size, origin, offset);});
+  }
+
+  // draws the byte range [start, end) of text on a single line from
+  // distance fields, see render_sdf()
+  inline void render_text(sdf_cache_t &cache, const text_metrics_t &tm, const string &text, size_t start, size_t end, fixed_point_t origin, fixed_t offset = 0) {
+    fixed_t size = fixed_size(tm);
+    while(start < end) {
+      uint16_t codepoint = next_codepoint(text, start);
+      const glyph_t *glyph = find_glyph(tm, codepoint);
+      if(glyph) {
+        render_sdf(cache.field(*glyph), size, origin, offset);
+      }
+      origin.x += character_advance(tm, codepoint);
+    }
+  }
+
+
+  /*
+    load functions
+  */
+
+  // big endian stream value helpers
+  inline uint16_t  ru16(ifstream &ifs) {uint8_t w[2]; ifs.read((char *)w, 2); return w[0] << 8 | w[1];}
+  inline int16_t   rs16(ifstream &ifs) {uint8_t w[2]; ifs.read((char *)w, 2); return w[0] << 8 | w[1];}
+  inline uint32_t  ru32(ifstream &ifs) {uint8_t dw[4]; ifs.read((char *)dw, 4); return dw[0] << 24 | dw[1] << 16 | dw[2] << 8 | dw[3];}
+  inline uint8_t   ru8(ifstream &ifs) {return ifs.get();}
+  inline int8_t    rs8(ifstream &ifs) {return ifs.get();}
+
+  // reads the rest of a stream with a single call into a buffer of exactly
+  // the right size
+  inline bool read_remaining(ifstream &ifs, vector<uint8_t> &data) {
+    streampos start = ifs.tellg();
+    ifs.seekg(0, ios::end);
+    streampos end = ifs.tellg();
+    ifs.seekg(start);
+    if(ifs.fail() || end < start) {
+      return false;
+    }
+
+    data.resize(end - start);
+    ifs.read((char *)data.data(), data.size());
+    return !ifs.fail();
+  }
+
+  // big endian memory value helpers
+  inline uint16_t  ru16(const uint8_t *p) {return p[0] << 8 | p[1];}
+  inline uint32_t  ru32(const uint8_t *p) {return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];}
+
+  // reads the codepoint, bounds, and advance from a dictionary entry
+  inline void read_glyph_metrics(const uint8_t *p, glyph_t &g) {
+    g.codepoint = ru16(p);
+    g.bounds.x  = (int8_t)p[2];
+    g.bounds.y  = (int8_t)p[3];
+    g.bounds.w  = p[4];
+    g.bounds.h  = p[5];
+    g.advance   = p[6];
+  }
+
+  // every contour read so far in a face, and its control point bitmask if the
+  // face has quadratic contours, for resolving contour references
+  struct contour_table_t {
+    vector<contour_t<int8_t>> contours;
+    vector<const uint8_t *> controls;
+    point_arena_t *moved_points = nullptr;  // of the face being loaded
+  };
+
+  // a parser must reject unknown flags that aren't optional, detail levels
+  // also can't be combined with quadratic contours
+  inline bool valid_flags(uint16_t flags) {
+    return !(flags & ~supported_flags & ~optional_flags) && !((flags & detail_levels) && (flags & quadratic_contours));
+  }
+
+  // bytes of control point bitmask before the points of a quadratic contour
+  constexpr unsigned control_bytes(unsigned count) {return (count + 7) / 8;}
+
+  // looks up an earlier contour by index, an exact copy shares its points
+  // while a moved copy needs its own in the face's arena (pretty-poly draws
+  // all of the contours of a glyph from a single origin so the offset can't
+  // be applied later). the control point bitmask is always shared
+  inline bool resolve_contour_reference(const contour_table_t &table, uint16_t index, int8_t dx, int8_t dy, contour_t<int8_t> &contour, const uint8_t *&control) {
+    if(index >= table.contours.size()) {
+      // reference to a contour that hasn't been read yet
+      return false;
+    }
+
+    contour = table.contours[index];
+    control = table.controls[index];
+    if(dx != 0 || dy != 0) {
+      if(!table.moved_points) {
+        // nowhere to keep the moved points
+        return false;
+      }
+      point_t<int8_t> *points = table.moved_points->allocate(contour.count);
+      for(unsigned i = 0; i < contour.count; i++) {
+        points[i] = point_t<int8_t>(contour.points[i].x + dx, contour.points[i].y + dy);
+      }
+      contour.points = points;
+    }
+    return true;
+  }
+
+  // reads the level table that follows the header when the detail_levels
+  // flag is set, returns its length in bytes or zero if it's invalid
+  inline size_t read_detail_levels(const uint8_t *p, const uint8_t *end, vector<uint8_t> &sizes) {
+    sizes.clear();
+    if(p >= end || p[0] == 0 || p + p[0] > end) {
+      return 0;
+    }
+    sizes.assign(p + 1, p + p[0]);
+    return p[0];
+  }
+
+  // reads a list of contours up to and including its end of contours marker
+  // from font data in memory and advances p past it. the points are stored
+  // as pairs of signed bytes in the file which is exactly the layout of
+  // point_t<int8_t> so they are used in place rather than copied, as are
+  // the control point bitmasks of quadratic contours
+  inline bool read_contours(const uint8_t *&p, const uint8_t *end, uint16_t flags, vector<contour_t<int8_t>> &contours, vector<const uint8_t *> &controls, contour_table_t &table) {
+    while(true) {
+      if(p + 2 > end) {
+        // contour data runs past the end of the font data
+        return false;
+      }
+
+      // if count is zero then this is the end of contour marker
+      uint16_t count = ru16(p);
+      p += 2;
+      if(count == 0) {
+        return true;
+      }
+
+      contour_t<int8_t> contour;
+      const uint8_t *control = nullptr;
+      if((flags & shared_contours) && (count & contour_reference)) {
+        if(p + 2 > end || !resolve_contour_reference(table, count & ~contour_reference, p[0], p[1], contour, control)) {
+          return false;
+        }
+        p += 2;
+      } else {
+        if(flags & quadratic_contours) {
+          control = p;
+          p += control_bytes(count);
+        }
+
+        if(p + count * 2 > end) {
+          return false;
+        }
+
+        contour = {(point_t<int8_t> *)p, count};
+        p += count * 2;
+      }
+
+      append(contours, contour);
+      if(flags & quadratic_contours) {
+        append(controls, control);
+      }
+
+      if(flags & shared_contours) {
+        append(table.contours, contour);
+        append(table.controls, control);
+      }
+    }
+  }
+
+  // reads the contours of a glyph, preceded by any lower detail levels
+  inline bool read_glyph_contours(const uint8_t *p, const uint8_t *end, uint16_t flags, glyph_t &g, const vector<uint8_t> &detail_sizes, contour_table_t &table) {
+    // existing levels are reused so that reading into the same glyph again
+    // keeps the capacity of their contour lists
+    grow(g.details, detail_sizes.size());
+    g.details.resize(detail_sizes.size());
+    for(size_t i = 0; i < detail_sizes.size(); i++) {
+      g.details[i].max_size = detail_sizes[i];
+      g.details[i].contours.clear();
+      if(!read_contours(p, end, flags, g.details[i].contours, g.controls, table)) {
+        return false;
+      }
+    }
+    return read_contours(p, end, flags, g.contours, g.controls, table);
+  }
+
+  // reads the strikes that follow the contour data when the embedded_strikes
+  // flag is set, each is a size and bits per pixel then a bitmap position
+  // and size for every glyph in dictionary order followed by their pixels.
+  // the bitmaps point into the data rather than being copied
+  inline bool read_strikes(const uint8_t *p, const uint8_t *end, const vector<uint16_t> &order, std::map<uint16_t, glyph_t> &glyphs) {
+    if(p >= end) {
+      return false;
+    }
+
+    uint8_t strike_count = *p++;
+    for(auto i = 0; i < strike_count; i++) {
+      if(p + 2 + order.size() * 4 > end) {
+        return false;
+      }
+
+      uint8_t size = p[0], bits = p[1];
+      if(bits != 1 && bits != 2 && bits != 4 && bits != 8) {
+        return false;
+      }
+
+      const uint8_t *entry = p + 2;
+      p += 2 + order.size() * 4;
+      for(auto codepoint : order) {
+        glyph_t::bitmap_t bitmap = {size, bits, (int8_t)entry[0], (int8_t)entry[1], entry[2], entry[3], p};
+        p += (bitmap.w * bitmap.h * bits + 7) / 8;
+        if(p > end) {
+          return false;
+        }
+        glyphs[codepoint].bitmaps.push_back(bitmap);
+        entry += 4;
+      }
+    }
+
+    return true;
+  }
+
+  inline bool face_t::load(ifstream &ifs, const decode_runner_t &runner) {
+    // the rest of the file is read with a single call and every contour
+    // points into it, rather than making an allocation per contour
+    auto contents = make_shared<vector<uint8_t>>();
+    if(!read_remaining(ifs, *contents) || !load(contents->data(), contents->size(), runner)) {
+      return false;
+    }
+
+    storage = contents;
+    return true;
+  }
+
+  inline bool face_t::load(string path, const decode_runner_t &runner) {
+    ifstream ifs(path, ios::binary);
+    if(ifs.fail()) {
+      // could not open file
+      return false;
+    }    
+    return load(ifs, runner);
+  }
+
+
+  inline bool face_t::load(const uint8_t *data, size_t size, const decode_runner_t &runner) {
+    // glyphs of an earlier load may point into the storage so both go, and
+    // a failed load leaves the face empty
+    this->glyphs.clear();
+    this->index.clear();
+    this->storage.reset();
+    this->moved_points.clear();
+
+    // check header magic bytes are present
+    if(size < 8 || memcmp(data, "af!?", 4) != 0) {
+      // doesn't start with magic marker
+      return false;
+    }
+
+    this->glyph_count = ru16(data + 4);
+    this->flags = ru16(data + 6);
+    if(!valid_flags(this->flags)) {
+      // unknown flags set
+      return false;
+    }
+
+    // sizes of the glyph detail levels, if present
+    size_t dictionary_offset = 8;
+    this->detail_sizes.clear();
+    if(this->flags & detail_levels) {
+      size_t length = read_detail_levels(data + 8, data + size, this->detail_sizes);
+      if(length == 0) {
+        // missing or invalid level table
+        return false;
+      }
+      dictionary_offset += length;
+    }
+
+    uint16_t entry_size = glyph_entry_size(this->flags);
+    uint32_t contour_data_offset = dictionary_offset + this->glyph_count * entry_size;
+    if(contour_data_offset > size) {
+      // glyph dictionary is truncated
+      return false;
+    }
+
+    // the dictionary is scanned first for where each glyph's contour data
+    // starts, and where the last ends since strikes follow it
+    const uint8_t *dictionary = data + dictionary_offset;
+    vector<uint32_t> offsets(this->glyph_count);
+    uint32_t contour_data_end = contour_data_offset;
+    for(auto i = 0; i < this->glyph_count; i++) {
+      const uint8_t *entry = dictionary + i * entry_size;
+      if(this->flags & absolute_offsets) {
+        contour_data_offset = ru32(entry + 9);
+      }
+      if(contour_data_offset > size) {
+        // contour data outside of the font data
+        return false;
+      }
+      offsets[i] = contour_data_offset;
+      contour_data_offset += ru16(entry + 7);
+      contour_data_end = max(contour_data_end, contour_data_offset);
+    }
+
+    vector<glyph_t> decoded(this->glyph_count);
+    auto decode = [&](size_t first, size_t last, contour_table_t &table) {
+      for(size_t i = first; i < last; i++) {
+        read_glyph_metrics(dictionary + i * entry_size, decoded[i]);
+        if(!read_glyph_contours(data + offsets[i], data + size, this->flags, decoded[i], this->detail_sizes, table)) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    // glyphs decode independently of each other unless contours can refer
+    // to those of earlier glyphs, below a few hundred glyphs handing out the
+    // work costs more than it saves
+    bool decoded_all;
+    if(runner && !(this->flags & shared_contours) && this->glyph_count >= 256) {
+      decoded_all = runner(this->glyph_count, [&](size_t first, size_t last) {
+        contour_table_t unused;
+        return decode(first, last, unused);
+      });
+    } else {
+      // every contour read so far, for resolving contour references
+      contour_table_t table;
+      table.moved_points = &this->moved_points;
+      decoded_all = decode(0, this->glyph_count, table);
+    }
+
+    if(!decoded_all) {
+      // could not read glyph contour data
+      return false;
+    }
+
+    // codepoints in dictionary order, for matching up embedded strikes
+    vector<uint16_t> order;
+    order.reserve(this->glyph_count);
+    std::map<uint16_t, glyph_t> loaded;
+    for(auto &g : decoded) {
+      order.push_back(g.codepoint);
+
+      // the dictionary is sorted so each glyph normally goes at the end
+      loaded.insert_or_assign(loaded.end(), g.codepoint, move(g));
+    }
+
+    if((this->flags & embedded_strikes) && !read_strikes(data + contour_data_end, data + size, order, loaded)) {
+      // could not read the embedded strikes
+      return false;
+    }
+
+    // only a face that has been read completely replaces the glyphs
+    this->glyphs = move(loaded);
+    build_index();
+    return true;
+  }
+
+  inline void face_t::build_index() {
+    index.clear();
+    index.codepoints.reserve(glyphs.size());
+    index.advances.reserve(glyphs.size());
+    index.bounds.reserve(glyphs.size());
+    index.glyphs.reserve(glyphs.size());
+    for(auto &[codepoint, glyph] : glyphs) {
+      index.codepoints.push_back(codepoint);
+      index.advances.push_back(glyph.advance);
+      index.bounds.push_back(glyph.bounds);
+      index.glyphs.push_back(&glyph);
+    }
+    index.built = true;
+  }
+
+
+  /*
+    decoded face functions
+  */
+
+  // decoded faces start with a 32 byte header of "afs!", a version, the face
+  // flags, a checksum of everything after the header, the glyph, contour,
+  // and bitmap counts, the arena size, and the number of detail levels. the
+  // detail level sizes, glyph, contour, and bitmap records, and the arena
+  // follow it in that order. records refer to the arena by offset so a
+  // decoded face can be loaded from anywhere, all values are big endian
+  constexpr uint16_t decoded_version = 1;
+  constexpr size_t decoded_header_size = 32;
+  constexpr size_t decoded_glyph_size = 20;
+  constexpr size_t decoded_contour_size = 12;
+  constexpr size_t decoded_bitmap_size = 12;
+  constexpr uint32_t decoded_no_control = 0xffffffff;
+
+  // 32-bit FNV-1a
+  inline uint32_t checksum(const uint8_t *p, size_t size) {
+    uint32_t h = 0x811c9dc5;
+    for(size_t i = 0; i < size; i++) {
+      h = (h ^ p[i]) * 0x01000193;
+    }
+    return h;
+  }
+
+  inline bool face_t::save_decoded(string path) const {
+    vector<uint8_t> glyph_records, contour_records, bitmap_records, arena;
+    auto w16 = [](vector<uint8_t> &out, uint16_t v) {out.push_back(v >> 8); out.push_back(v);};
+    auto w32 = [&w16](vector<uint8_t> &out, uint32_t v) {w16(out, v >> 16); w16(out, v);};
+
+    // shared contours point at the same data so it's only stored once
+    std::map<const uint8_t *, uint32_t> offsets;
+    auto store = [&](const uint8_t *data, size_t length) {
+      auto it = offsets.find(data);
+      if(it != offsets.end()) {
+        return it->second;
+      }
+      uint32_t offset = arena.size();
+      arena.insert(arena.end(), data, data + length);
+      offsets[data] = offset;
+      return offset;
+    };
+
+    uint32_t contour_count = 0, bitmap_count = 0;
+    for(auto &[codepoint, glyph] : glyphs) {
+      // contours are stored as they're read from a face file, lower detail
+      // levels first, which is also the order of the control bitmasks
+      uint32_t first_contour = contour_count;
+      size_t control_index = 0;
+      for(size_t level = 0; level <= glyph.details.size(); level++) {
+        auto &contours = level < glyph.details.size() ? glyph.details[level].contours : glyph.contours;
+        for(auto &contour : contours) {
+          w32(contour_records, store((const uint8_t *)contour.points, contour.count * 2));
+          w16(contour_records, contour.count);
+          contour_records.push_back(level);
+          contour_records.push_back(0);
+          if(control_index < glyph.controls.size()) {
+            w32(contour_records, store(glyph.controls[control_index++], control_bytes(contour.count)));
+          } else {
+            w32(contour_records, decoded_no_control);
+          }
+          contour_count++;
+        }
+      }
+
+      for(auto &bitmap : glyph.bitmaps) {
+        bitmap_records.insert(bitmap_records.end(), {bitmap.size, bitmap.bits, uint8_t(bitmap.x), uint8_t(bitmap.y), bitmap.w, bitmap.h, 0, 0});
+        w32(bitmap_records, store(bitmap.data, (bitmap.w * bitmap.h * bitmap.bits + 7) / 8));
+      }
+
+      w16(glyph_records, codepoint);
+      glyph_records.insert(glyph_records.end(), {uint8_t(glyph.bounds.x), uint8_t(glyph.bounds.y), uint8_t(glyph.bounds.w), uint8_t(glyph.bounds.h), glyph.advance, uint8_t(glyph.bitmaps.size())});
+      w32(glyph_records, first_contour);
+      w32(glyph_records, contour_count - first_contour);
+      w32(glyph_records, bitmap_count);
+      bitmap_count += glyph.bitmaps.size();
+    }
+
+    vector<uint8_t> body(detail_sizes);
+    body.insert(body.end(), glyph_records.begin(), glyph_records.end());
+    body.insert(body.end(), contour_records.begin(), contour_records.end());
+    body.insert(body.end(), bitmap_records.begin(), bitmap_records.end());
+    body.insert(body.end(), arena.begin(), arena.end());
+
+    vector<uint8_t> header = {'a', 'f', 's', '!'};
+    w16(header, decoded_version);
+    w16(header, flags);
+    w32(header, checksum(body.data(), body.size()));
+    w32(header, glyphs.size());
+    w32(header, contour_count);
+    w32(header, bitmap_count);
+    w32(header, arena.size());
+    w16(header, detail_sizes.size());
+    w16(header, 0);
+
+    ofstream ofs(path, ios::binary);
+    ofs.write((const char *)header.data(), header.size());
+    ofs.write((const char *)body.data(), body.size());
+    return ofs.good();
+  }
+
+  inline bool face_t::load_decoded(const uint8_t *data, size_t size, bool verify) {
+    this->glyphs.clear();
+    this->index.clear();
+    this->storage.reset();
+    this->moved_points.clear();
+
+    if(size < decoded_header_size || memcmp(data, "afs!", 4) != 0) {
+      // not a decoded face
+      return false;
+    }
+
+    if(ru16(data + 4) != decoded_version) {
+      // written by an incompatible version
+      return false;
+    }
+
+    uint16_t flags = ru16(data + 6);
+    uint32_t glyph_count = ru32(data + 12);
+    uint32_t contour_count = ru32(data + 16);
+    uint32_t bitmap_count = ru32(data + 20);
+    uint32_t arena_size = ru32(data + 24);
+    uint16_t level_count = ru16(data + 28);
+    if(!valid_flags(flags) || glyph_count > 0xffff) {
+      // unknown flags set or impossible glyph count
+      return false;
+    }
+
+    // sizes are checked in 64 bits so huge counts can't wrap around
+    uint64_t length = decoded_header_size + uint64_t(level_count) + uint64_t(glyph_count) * decoded_glyph_size +
+      uint64_t(contour_count) * decoded_contour_size + uint64_t(bitmap_count) * decoded_bitmap_size + arena_size;
+    if(length != size) {
+      // truncated or has trailing data
+      return false;
+    }
+
+    if(verify && ru32(data + 8) != checksum(data + decoded_header_size, size - decoded_header_size)) {
+      // corrupted
+      return false;
+    }
+
+    const uint8_t *p = data + decoded_header_size;
+    this->detail_sizes.assign(p, p + level_count);
+    const uint8_t *glyph_records = p + level_count;
+    const uint8_t *contour_records = glyph_records + glyph_count * decoded_glyph_size;
+    const uint8_t *bitmap_records = contour_records + contour_count * decoded_contour_size;
+    const uint8_t *arena = bitmap_records + bitmap_count * decoded_bitmap_size;
+
+    // arena offsets are checked against the length of what they point to
+    auto in_arena = [arena_size](uint32_t offset, size_t length) {
+      return offset <= arena_size && length <= arena_size - offset;
+    };
+
+    for(uint32_t i = 0; i < glyph_count; i++) {
+      const uint8_t *r = glyph_records + i * decoded_glyph_size;
+      uint8_t glyph_bitmaps = r[7];
+      uint32_t first_contour = ru32(r + 8), glyph_contours = ru32(r + 12), first_bitmap = ru32(r + 16);
+      if(first_contour > contour_count || glyph_contours > contour_count - first_contour ||
+         first_bitmap > bitmap_count || glyph_bitmaps > bitmap_count - first_bitmap) {
+        // records out of range
+        this->glyphs.clear();
+        return false;
+      }
+
+      glyph_t g;
+      g.codepoint = ru16(r);
+      g.bounds.x = int8_t(r[2]);
+      g.bounds.y = int8_t(r[3]);
+      g.bounds.w = r[4];
+      g.bounds.h = r[5];
+      g.advance = r[6];
+      for(auto max_size : this->detail_sizes) {
+        g.details.push_back({max_size, {}});
+      }
+
+      for(uint32_t j = 0; j < glyph_contours; j++) {
+        const uint8_t *c = contour_records + (first_contour + j) * decoded_contour_size;
+        uint32_t offset = ru32(c), control = ru32(c + 8);
+        uint16_t count = ru16(c + 4);
+        uint8_t level = c[6];
+        bool quadratic = control != decoded_no_control;
+        if(level > level_count || !in_arena(offset, count * 2) || (quadratic && !in_arena(control, control_bytes(count)))) {
+          // invalid level or data outside of the arena
+          this->glyphs.clear();
+          return false;
+        }
+
+        auto &contours = level < level_count ? g.details[level].contours : g.contours;
+        contours.push_back({(point_t<int8_t> *)(arena + offset), count});
+        if(quadratic) {
+          g.controls.push_back(arena + control);
+        }
+      }
+
+      for(uint32_t j = 0; j < glyph_bitmaps; j++) {
+        const uint8_t *b = bitmap_records + (first_bitmap + j) * decoded_bitmap_size;
+        glyph_t::bitmap_t bitmap = {b[0], b[1], int8_t(b[2]), int8_t(b[3]), b[4], b[5], nullptr};
+        uint32_t offset = ru32(b + 8);
+        bool valid_bits = bitmap.bits == 1 || bitmap.bits == 2 || bitmap.bits == 4 || bitmap.bits == 8;
+        if(!valid_bits || !in_arena(offset, (bitmap.w * bitmap.h * bitmap.bits + 7) / 8)) {
+          // unsupported bit depth or data outside of the arena
+          this->glyphs.clear();
+          return false;
+        }
+        bitmap.data = arena + offset;
+        g.bitmaps.push_back(bitmap);
+      }
+
+      this->glyphs[g.codepoint] = move(g);
+    }
+
+    this->glyph_count = glyph_count;
+    this->flags = flags;
+    build_index();
+    return true;
+  }
+
+  inline bool face_t::load_decoded(string path, bool verify) {
+    ifstream ifs(path, ios::binary);
+    if(ifs.fail()) {
+      // could not open file
+      return false;
+    }
+
+    // read into memory the face keeps with a single call, to avoid the copy
+    // map the file and load from the mapping instead
+    auto contents = make_shared<vector<uint8_t>>();
+    if(!read_remaining(ifs, *contents) || !load_decoded(contents->data(), contents->size(), verify)) {
+      return false;
+    }
+
+    storage = contents;
+    return true;
+  }
+
+
+  /*
+    collection functions
+  */
+
+  inline bool collection_t::load(const uint8_t *data, size_t size) {
+    this->data = data;
+    this->size = size;
+    this->entries.clear();
+
+    // check header magic bytes are present
+    if(size < 8 || memcmp(data, "afc!", 4) != 0) {
+      return false;
+    }
+
+    uint16_t face_count = ru16(data + 4);
+    if(ru16(data + 6) != 0) {
+      // unknown flags set
+      return false;
+    }
+
+    // read the face directory
+    size_t offset = 8;
+    for(auto i = 0; i < face_count; i++) {
+      if(offset + 1 > size || offset + 1 + data[offset] + 8 > size) {
+        // directory is truncated
+        return false;
+      }
+
+      entry_t e;
+      uint8_t name_length = data[offset];
+      e.name = string((const char *)data + offset + 1, name_length);
+      offset += 1 + name_length;
+      e.glyph_count = ru16(data + offset);
+      e.flags       = ru16(data + offset + 2);
+      e.dictionary  = ru32(data + offset + 4);
+      offset += 8;
+
+      // level table follows the entry if the face has detail levels
+      if(e.flags & detail_levels) {
+        size_t length = read_detail_levels(data + offset, data + size, e.detail_sizes);
+        if(length == 0) {
+          return false;
+        }
+        offset += length;
+      }
+
+      this->entries.push_back(e);
+    }
+
+    return true;
+  }
+
+  inline bool collection_t::load(string path) {
+    ifstream ifs(path, ios::binary);
+    if(ifs.fail()) {
+      // could not open file
+      return false;
+    }
+
+    // the whole collection is read with a single call and every face is a
+    // view onto it
+    return read_remaining(ifs, storage) && load(storage.data(), storage.size());
+  }
+
+  // index of the face with the given name or -1 if there isn't one
+  inline int collection_t::find(const string &name) const {
+    for(size_t i = 0; i < entries.size(); i++) {
+      if(entries[i].name == name) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  inline bool collection_t::face(size_t index, face_t &face) const {
+    if(index >= entries.size()) {
+      return false;
+    }
+
+    const entry_t &e = entries[index];
+    if(!valid_flags(e.flags)) {
+      // unknown flags set
+      return false;
+    }
+
+    uint16_t entry_size = 11;
+    if(e.dictionary + e.glyph_count * entry_size > size) {
+      // glyph dictionary is truncated
+      return false;
+    }
+
+    face.glyph_count = e.glyph_count;
+    face.flags = e.flags;
+    face.detail_sizes = e.detail_sizes;
+    face.glyphs.clear();
+    face.index.clear();
+    face.storage.reset();
+    face.moved_points.clear();
+
+    // every contour read so far, for resolving contour references
+    contour_table_t table;
+    table.moved_points = &face.moved_points;
+
+    // dictionary entries hold an absolute offset to their contour data
+    // which may be shared with other glyphs or faces in the collection
+    const uint8_t *entry = data + e.dictionary;
+    for(auto i = 0; i < e.glyph_count; i++, entry += entry_size) {
+      glyph_t g;
+      read_glyph_metrics(entry, g);
+
+      uint32_t contour_data_offset = ru32(entry + 7);
+      if(contour_data_offset > size || !read_glyph_contours(data + contour_data_offset, data + size, e.flags, g, e.detail_sizes, table)) {
+        // could not read glyph contour data
+        return false;
+      }
+
+      face.glyphs[g.codepoint] = move(g);
+    }
+
+    face.build_index();
+    return true;
+  }
+
+
+  /*
+    streaming face functions
+  */
+
+  inline bool read_stream(void *context, uint32_t offset, uint8_t *buffer, uint32_t length) {
+    ifstream &ifs = *(ifstream *)context;
+    ifs.clear();
+    ifs.seekg(offset, ios::beg);
+    ifs.read((char *)buffer, length);
+    return !ifs.fail();
+  }
+
+  inline bool stream_face_t::load(ifstream &ifs) {
+    return load(read_stream, &ifs);
+  }
+
+  inline bool stream_face_t::load(read_callback_t read, void *context) {
+    this->read = read;
+    this->context = context;
+    this->entries.clear();
+    this->detail_sizes.clear();
+
+    uint8_t header[8];
+    if(!read(context, 0, header, 8) || memcmp(header, "af!?", 4) != 0) {
+      // doesn't start with magic marker
+      return false;
+    }
+
+    uint16_t glyph_count = ru16(header + 4);
+    this->flags = ru16(header + 6);
+    if(!valid_flags(this->flags) || (this->flags & shared_contours)) {
+      // unknown flags set or glyphs can't be read on their own
+      return false;
+    }
+
+    // sizes of the glyph detail levels, if present
+    this->dictionary = 8;
+    if(this->flags & detail_levels) {
+      uint8_t level_count;
+      if(!read(context, 8, &level_count, 1) || level_count == 0) {
+        return false;
+      }
+      uint8_t levels[256];
+      if(!read(context, 8, levels, level_count) || read_detail_levels(levels, levels + level_count, this->detail_sizes) == 0) {
+        // missing or invalid level table
+        return false;
+      }
+      this->dictionary += level_count;
+    }
+
+    // one pass over the dictionary, a glyph's contour data starts where the
+    // previous glyph's ends unless the entry holds its offset
+    const uint16_t entry_size = glyph_entry_size(flags);
+    uint32_t offset = this->dictionary + glyph_count * entry_size;
+    uint16_t largest = 0;
+    this->entries.reserve(glyph_count);
+    for(auto i = 0; i < glyph_count; i++) {
+      uint8_t entry[13];
+      if(!read(context, this->dictionary + i * entry_size, entry, entry_size)) {
+        // could not read glyph dictionary entry
+        this->entries.clear();
+        return false;
+      }
+
+      uint16_t length = ru16(entry + 7);
+      if(flags & absolute_offsets) {
+        offset = ru32(entry + 9);
+      }
+      this->entries.push_back({ru16(entry), uint16_t(i), length, offset});
+      largest = max(largest, length);
+      offset += length;
+    }
+
+    sort(this->entries.begin(), this->entries.end(), [](const entry_t &a, const entry_t &b) {return a.codepoint < b.codepoint;});
+    this->buffer.assign(largest, 0);
+    return true;
+  }
+
+  inline const glyph_t *stream_face_t::glyph(uint16_t codepoint) {
+    const entry_t *e = find(codepoint);
+    if(!e) {
+      return nullptr;
+    }
+
+    uint8_t entry[9];
+    if(!read(context, dictionary + e->index * glyph_entry_size(flags), entry, 9) ||
+       !read(context, e->offset, buffer.data(), e->length)) {
+      return nullptr;
+    }
+
+    // the vectors keep their capacity so reading glyphs of the same size or
+    // smaller doesn't allocate
+    current.contours.clear();
+    current.controls.clear();
+    read_glyph_metrics(entry, current);
+
+    // without shared contours the table is never used
+    static contour_table_t table;
+    if(!read_glyph_contours(buffer.data(), buffer.data() + e->length, flags, current, detail_sizes, table)) {
+      return nullptr;
+    }
+    return &current;
+  }
+
+  inline int stream_face_t::advance(uint16_t codepoint) {
+    const entry_t *e = find(codepoint);
+    uint8_t advance = 0;
+    if(e) {
+      read(context, dictionary + e->index * glyph_entry_size(flags) + 6, &advance, 1);
+    }
+    return advance;
+  }
+
+  // width in pixels of text drawn from a streaming face
+  inline int measure(stream_face_t &face, fixed_t size, string_view text) {
+    fixed_t width = 0;
+    size_t i = 0;
+    while(i < text.size()) {
+      width += (face.advance(next_codepoint(text, i)) * size) >> 7;
+    }
+    return fixed_round(width);
+  }
+
+  // draws text on a single line with the baseline of the first character at
+  // origin, each glyph is read from the face just before it's drawn
+  inline void render_text(stream_face_t &face, fixed_t size, string_view text, fixed_point_t origin) {
+    // glyphs are drawn on their own so the metrics only need the size
+    static face_t none;
+    text_metrics_t tm(none, 0);
+    tm.set_size(size);
+
+    size_t i = 0;
+    while(i < text.size()) {
+      const glyph_t *glyph = face.glyph(next_codepoint(text, i));
+      if(glyph) {
+        render_glyph(tm, *glyph, origin);
+        origin.x += (glyph->advance * size) >> 7;
+      }
+    }
+  }
+
+
+  /*
+    raster cache functions
+  */
+
+  // 64-bit FNV-1a hash of everything in a face that affects how its glyphs
+  // rasterise
+  inline uint64_t content_hash(const face_t &face) {
+    uint64_t h = 0xcbf29ce484222325;
+    auto mix = [&h](int32_t v) {
+      for(auto i = 0; i < 4; i++, v >>= 8) {
+        h = (h ^ uint8_t(v)) * 0x100000001b3;
+      }
+    };
+    auto mix_contours = [&mix](const vector<contour_t<int8_t>> &contours) {
+      mix(contours.size());
+      for(auto &contour : contours) {
+        mix(contour.count);
+        for(unsigned i = 0; i < contour.count; i++) {
+          mix(uint8_t(contour.points[i].x) << 8 | uint8_t(contour.points[i].y));
+        }
+      }
+    };
+
+    mix(face.flags);
+    for(auto &[codepoint, glyph] : face.glyphs) {
+      mix(codepoint);
+      mix(glyph.bounds.x); mix(glyph.bounds.y);
+      mix(glyph.bounds.w); mix(glyph.bounds.h);
+      mix(glyph.advance);
+      mix_contours(glyph.contours);
+      for(auto &detail : glyph.details) {
+        mix(detail.max_size);
+        mix_contours(detail.contours);
+      }
+      for(size_t i = 0; i < glyph.controls.size(); i++) {
+        for(unsigned j = 0; j < (glyph.contours[i].count + 7) / 8; j++) {
+          mix(glyph.controls[i][j]);
+        }
+      }
+    }
+    return h;
+  }
+
+  inline void raster_cache_t::clear() {
+    entries.clear();
+    storage.clear();
+    hash = content_hash(face);
+  }
+
+  inline const raster_cache_t::entry_t *raster_cache_t::find(const glyph_t &glyph, fixed_t size, antialias_t antialias, int subpixel) {
+    assert(holds(glyph));
+    auto it = entries.find(key_t(glyph.codepoint, size, antialias, subpixel));
+    if(it == entries.end()) {
+      misses++;
+      return nullptr;
+    }
+
+    hits++;
+    return &it->second;
+  }
+
+  inline const raster_cache_t::entry_t *raster_cache_t::add(const glyph_t &glyph, fixed_t size, antialias_t antialias, int subpixel, rect_t bounds, const vector<uint8_t> &coverage) {
+    assert(holds(glyph));
+    check_heap();
+    entry_t &e = entries[key_t(glyph.codepoint, size, antialias, subpixel)];
+    e.bounds = bounds;
+    e.recorded = coverage;
+    e.data = e.recorded.data();
+    return &e;
+  }
+
+  // cache files start with "afr!", a version, the entry count, and the face
+  // hash. then a 16 byte entry per glyph followed by the coverage values of
+  // every entry in the same order. all values are big endian
+  constexpr uint16_t raster_cache_version = 1;
+  constexpr size_t raster_cache_header_size = 18;
+  constexpr size_t raster_cache_entry_size = 16;
+
+  inline bool raster_cache_t::load(const uint8_t *data, size_t size) {
+    entries.clear();
+
+    if(size < raster_cache_header_size || memcmp(data, "afr!", 4) != 0) {
+      // not a raster cache
+      return false;
+    }
+
+    if(ru16(data + 4) != raster_cache_version) {
+      // written by an incompatible version
+      return false;
+    }
+
+    uint32_t count = ru32(data + 6);
+    uint64_t file_hash = uint64_t(ru32(data + 10)) << 32 | ru32(data + 14);
+    if(file_hash != hash) {
+      // made from a different face, or an earlier version of this one
+      return false;
+    }
+
+    if(count > (size - raster_cache_header_size) / raster_cache_entry_size) {
+      // entry table is truncated
+      return false;
+    }
+
+    const uint8_t *entry = data + raster_cache_header_size;
+    const uint8_t *coverage = entry + count * raster_cache_entry_size;
+    const uint8_t *end = data + size;
+    for(uint32_t i = 0; i < count; i++, entry += raster_cache_entry_size) {
+      uint16_t codepoint = ru16(entry);
+      int antialias = entry[2];
+      int subpixel = entry[3];
+      fixed_t glyph_size = ru32(entry + 4);
+      rect_t bounds(int16_t(ru16(entry + 8)), int16_t(ru16(entry + 10)), ru16(entry + 12), ru16(entry + 14));
+      size_t length = bounds.w * bounds.h;
+      if(antialias > X16 || subpixel >= subpixel_bins * subpixel_bins || size_t(end - coverage) < length) {
+        // invalid antialiasing level or subpixel bin, or coverage values
+        // are truncated
+        entries.clear();
+        return false;
+      }
+
+      entry_t &e = entries[key_t(codepoint, glyph_size, antialias, subpixel)];
+      e.bounds = bounds;
+      e.data = coverage;
+      coverage += length;
+    }
+
+    return true;
+  }
+
+  inline bool raster_cache_t::load(string path) {
+    ifstream ifs(path, ios::binary);
+    if(ifs.fail()) {
+      // could not open file
+      return false;
+    }
+
+    // read with a single call, the entries are then a view onto it
+    vector<uint8_t> contents;
+    if(!read_remaining(ifs, contents) || !load(contents.data(), contents.size())) {
+      return false;
+    }
+
+    // the vector buffer moves with it so the entries stay valid
+    storage = move(contents);
+    return true;
+  }
+
+  inline bool raster_cache_t::save(string path) const {
+    vector<uint8_t> out;
+    auto w16 = [&out](uint16_t v) {out.push_back(v >> 8); out.push_back(v);};
+    auto w32 = [&w16](uint32_t v) {w16(v >> 16); w16(v);};
+
+    out.insert(out.end(), {'a', 'f', 'r', '!'});
+    w16(raster_cache_version);
+    w32(entries.size());
+    w32(hash >> 32);
+    w32(hash);
+
+    for(auto &[key, e] : entries) {
+      w16(get<0>(key));
+      out.push_back(get<2>(key));
+      out.push_back(get<3>(key));
+      w32(get<1>(key));
+      w16(e.bounds.x); w16(e.bounds.y);
+      w16(e.bounds.w); w16(e.bounds.h);
+    }
+
+    for(auto &[key, e] : entries) {
+      out.insert(out.end(), e.data, e.data + e.bounds.w * e.bounds.h);
+    }
+
+    ofstream ofs(path, ios::binary);
+    ofs.write((const char *)out.data(), out.size());
+    return ofs.good();
   }
 
 }
\ No newline at end of file
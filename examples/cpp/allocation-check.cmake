@@ -0,0 +1,4 @@
+add_executable(
+  allocation-check 
+  allocation-check.cpp
+)
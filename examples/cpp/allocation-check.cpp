@@ -0,0 +1,76 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "alright-fonts.hpp"
+
+using namespace alright_fonts;
+
+// every heap allocation in the program, including any made by pretty-poly
+long allocations = 0;
+
+// the replacements are kept out of line, once inlined gcc sees memory from
+// malloc() passed to operator delete and warns about a mismatch
+__attribute__((noinline)) void *operator new(size_t size) {
+  allocations++;
+  void *p = malloc(size ? size : 1);
+  if(!p) {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {free(p);}
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {free(p);}
+
+constexpr int WIDTH = 320;
+constexpr int HEIGHT = 240;
+
+uint8_t image[WIDTH * HEIGHT];
+
+void callback(const tile_t &tile) {
+  for(auto y = 0; y < tile.bounds.h; y++) {
+    for(auto x = 0; x < tile.bounds.w; x++) {
+      image[(y + tile.bounds.y) * WIDTH + x + tile.bounds.x] = tile.data[x + y * tile.stride];
+    }
+  }
+}
+
+const string text = "The quick brown fox jumps over the lazy dog. 0123456789 Sphinx of black quartz, judge my vow!";
+
+// draws a full line of text at whole and fractional sizes and positions
+void render(face_t &face) {
+  for(int size : {8, 13, 24}) {
+    text_metrics_t tm(face, size);
+    render_text(tm, text, 0, text.size(), point_t<int>(0, 40));
+    tm.set_size(to_fixed(size) + 17);
+    render_text(tm, text, 0, text.size(), fixed_point(to_fixed(3) + 21, to_fixed(80)));
+  }
+}
+
+// checks that once the scratch buffers have grown, rendering text makes no
+// heap allocations in alright-fonts itself. exits with 1 if it does. the
+// rest, which pretty-poly makes, are reported but don't fail the check
+int main(int argc, char **argv) {
+  std::string font_path = argc > 1 ? argv[1] : "sample-fonts/OpenSans/OpenSans-Regular.af";
+
+  set_options(callback, X4, {0, 0, WIDTH, HEIGHT});
+
+  face_t face(font_path);
+  if(face.glyphs.empty()) {
+    printf("could not load %s\n", font_path.c_str());
+    return 1;
+  }
+
+  // the first render grows the scratch buffers to their working size
+  render(face);
+
+  long before = allocations, library_before = heap_allocations;
+  render(face);
+  long made = allocations - before, library = heap_allocations - library_before;
+
+  printf("rendering text with %s\n", font_path.c_str());
+  printf("  %ld allocations by alright-fonts\n", library);
+  printf("  %ld other allocations, pretty-poly's\n", max(made - library, 0L));
+  return library == 0 ? 0 : 1;
+}
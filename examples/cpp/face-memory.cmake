@@ -0,0 +1,4 @@
+add_executable(
+  face-memory 
+  face-memory.cpp
+)
@@ -0,0 +1,111 @@
+#include <cstdlib>
+#include <new>
+
+#include "alright-fonts.hpp"
+
+#include <chrono>
+
+#include "synthetic-face.hpp"
+
+using namespace alright_fonts;
+
+// every heap allocation in the program and the bytes still allocated, each
+// block is prefixed with its size so that frees can be counted too
+long allocations = 0;
+long live_bytes = 0;
+
+constexpr size_t prefix = alignof(max_align_t);
+
+// the replacements are kept out of line, once inlined gcc sees memory from
+// malloc() passed to operator delete and warns about a mismatch
+__attribute__((noinline)) void *operator new(size_t size) {
+  uint8_t *p = (uint8_t *)malloc(size + prefix);
+  if(!p) {
+    throw bad_alloc();
+  }
+  allocations++;
+  live_bytes += size;
+  *(size_t *)p = size;
+  return p + prefix;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+  if(p) {
+    uint8_t *block = (uint8_t *)p - prefix;
+    live_bytes -= *(size_t *)block;
+    free(block);
+  }
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {operator delete(p);}
+
+// nanoseconds per call of fn(codepoint) over a fixed list of codepoints
+template<typename F> double time_per_call(const vector<uint16_t> &codepoints, F fn) {
+  double best = 1e9;
+  for(int run = 0; run < 5; run++) {
+    auto start = chrono::steady_clock::now();
+    for(auto codepoint : codepoints) {
+      fn(codepoint);
+    }
+    best = min(best, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / codepoints.size());
+  }
+  return best;
+}
+
+// reports the heap a loaded face holds on to and how long advance, bounds
+// and glyph lookups take through the face index and through the map alone
+void report(const string &name, const uint8_t *data, size_t size) {
+  long bytes = live_bytes, count = allocations;
+  face_t face;
+  if(!face.load(data, size)) {
+    printf("could not load %s\n", name.c_str());
+    exit(1);
+  }
+  bytes = live_bytes - bytes;
+  count = allocations - count;
+
+  size_t index_bytes = face.index.codepoints.capacity() * sizeof(uint16_t) + face.index.advances.capacity() +
+    face.index.bounds.capacity() * sizeof(rect_t) + face.index.glyphs.capacity() * sizeof(const glyph_t *);
+
+  // random codepoints from the whole face, so that lookups miss the cache
+  // as text in a large face would
+  vector<uint16_t> present;
+  for(auto &[codepoint, glyph] : face.glyphs) {
+    present.push_back(codepoint);
+  }
+
+  mt19937 random(present.size());
+  vector<uint16_t> codepoints;
+  for(int i = 0; i < 200000; i++) {
+    codepoints.push_back(present[random() % present.size()]);
+  }
+
+  text_metrics_t tm(face, 16);
+  volatile long sink = 0;
+  printf("%s, %zu glyphs\n", name.c_str(), face.glyphs.size());
+  printf("  heap %9ld bytes in %ld allocations, %zu bytes of it the index\n", bytes, count, index_bytes);
+  for(bool indexed : {true, false}) {
+    if(!indexed) {
+      face.index.clear();
+    }
+    double advance = time_per_call(codepoints, [&](uint16_t c) {sink += character_advance(tm, c);});
+    double bounds = time_per_call(codepoints, [&](uint16_t c) {sink += character_bounds(tm, c, fixed_point_t()).w;});
+    double find = time_per_call(codepoints, [&](uint16_t c) {sink += (long)face.find(c);});
+    printf("  %-10s advance %6.1fns  bounds %6.1fns  find %6.1fns\n", indexed ? "index" : "map only", advance, bounds, find);
+  }
+}
+
+int main(int argc, char **argv) {
+  for(uint16_t glyph_count : {2000, 8000, 20000}) {
+    vector<uint8_t> data = synthetic_face(glyph_count);
+    report("synthetic face", data.data(), data.size());
+  }
+
+  for(int i = 1; i < argc; i++) {
+    ifstream ifs(argv[i], ios::binary);
+    vector<uint8_t> data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    report(argv[i], data.data(), data.size());
+  }
+
+  return 0;
+}
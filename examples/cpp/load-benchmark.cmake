@@ -0,0 +1,7 @@
+add_executable(
+  load-benchmark 
+  load-benchmark.cpp
+)
+
+find_package(Threads REQUIRED)
+target_link_libraries(load-benchmark Threads::Threads)
@@ -0,0 +1,91 @@
+#include "alright-fonts-threads.hpp"
+
+#include <chrono>
+
+#include "synthetic-face.hpp"
+
+using namespace alright_fonts;
+
+// fastest of a few loads in milliseconds
+double time_load(const vector<uint8_t> &data, const decode_runner_t &runner) {
+  double best = 1e9;
+  for(int run = 0; run < 7; run++) {
+    auto start = chrono::steady_clock::now();
+    face_t face;
+    if(!face.load(data.data(), data.size(), runner)) {
+      printf("failed to load synthetic face\n");
+      exit(1);
+    }
+    best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+// milliseconds taken by fn
+template<typename F> double time_ms(F fn) {
+  auto start = chrono::steady_clock::now();
+  fn();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  printf("%u hardware threads\n\n", thread::hardware_concurrency());
+  printf("  glyphs  file size  threads  load time  speedup\n");
+
+  for(uint16_t glyph_count : {2000, 8000, 20000}) {
+    vector<uint8_t> data = synthetic_face(glyph_count);
+    double single = time_load(data, nullptr);
+    printf("%8d %8zukB %8s %8.2fms %7.2fx\n", glyph_count, data.size() / 1024, "-", single, 1.0);
+
+    for(unsigned workers : {1, 2, 4, 8}) {
+      // the loading thread decodes too so there is one more than the pool
+      worker_pool_t pool(workers);
+      double parallel = time_load(data, pool_runner(pool));
+      printf("%8s %10s %8u %8.2fms %7.2fx\n", "", "", workers + 1, parallel, single / parallel);
+    }
+  }
+
+  // an app opening a dozen faces of different sizes at startup, one after
+  // another and then all at once with load_async()
+  vector<string> paths;
+  for(int i = 0; i < 12; i++) {
+    paths.push_back((filesystem::temp_directory_path() / ("load-benchmark-" + to_string(i) + ".af")).string());
+    vector<uint8_t> data = synthetic_face(500 + i * i * 100);
+    ofstream(paths.back(), ios::binary).write((const char *)data.data(), data.size());
+  }
+
+  // the faces are kept until every one has loaded, as an app would
+  worker_pool_t pool;
+  double slowest = 1e9, sequential = 1e9, concurrent = 1e9;
+  for(int run = 0; run < 5; run++) {
+    double longest = 0;
+    sequential = min(sequential, time_ms([&paths, &longest]() {
+      vector<face_t> faces(paths.size());
+      for(size_t i = 0; i < paths.size(); i++) {
+        longest = max(longest, time_ms([&]() {faces[i].load(paths[i]);}));
+      }
+    }));
+    slowest = min(slowest, longest);
+
+    concurrent = min(concurrent, time_ms([&pool, &paths]() {
+      vector<pending_face_t> faces;
+      for(auto &path : paths) {
+        faces.push_back(load_async(pool, path));
+      }
+      for(auto &face : faces) {
+        face.wait();
+      }
+    }));
+  }
+
+  printf("\n%zu faces at startup\n", paths.size());
+  printf("  one after another %8.2fms\n", sequential);
+  printf("  with load_async() %8.2fms\n", concurrent);
+  printf("  slowest face      %8.2fms\n", slowest);
+
+  for(auto &path : paths) {
+    filesystem::remove(path);
+  }
+
+  return 0;
+}
@@ -0,0 +1,4 @@
+add_executable(
+  render-benchmark 
+  render-benchmark.cpp
+)
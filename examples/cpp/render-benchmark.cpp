@@ -0,0 +1,73 @@
+#include <cstdio>
+
+#include "alright-fonts.hpp"
+
+#include <chrono>
+#include <random>
+
+using namespace alright_fonts;
+
+// read from every tile so that the rendering can't be optimised away
+volatile long sink = 0;
+
+void callback(const tile_t &tile) {
+  sink += tile.data[0] + tile.data[(tile.bounds.h - 1) * tile.stride + tile.bounds.w - 1];
+}
+
+// fastest nanoseconds per pixel of a few runs of fn, which draws pixels
+template<typename F> double ns_per_pixel(long pixels, F fn) {
+  double best = 1e18;
+  for(int run = 0; run < 50; run++) {
+    auto start = chrono::steady_clock::now();
+    fn();
+    best = min(best, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+  }
+  return best / pixels;
+}
+
+// times the per-pixel loops that scale to the antialias level, strike
+// bitmaps at each bit depth and a distance field, at X4 and X16
+int main(int argc, char **argv) {
+  std::string font_path = argc > 1 ? argv[1] : "sample-fonts/OpenSans/OpenSans-Regular.af";
+
+  face_t face(font_path);
+  const glyph_t *glyph = face.find('g');
+  if(!glyph) {
+    printf("could not load %s\n", font_path.c_str());
+    return 1;
+  }
+
+  sdf_t sdf;
+  sdf.build(*glyph, 32, 4);
+
+  // random pixels, enough for a 64x64 bitmap at 8 bits per pixel
+  mt19937 random(1);
+  vector<uint8_t> pixels(64 * 64);
+  for(auto &p : pixels) {
+    p = random();
+  }
+
+  printf("nanoseconds per pixel\n\n");
+  printf("         1-bit   2-bit   4-bit   8-bit     sdf\n");
+  for(antialias_t antialias : {X4, X16}) {
+    set_options(callback, antialias, {0, 0, 1000, 1000});
+    printf("%-6s", antialias == X4 ? "X4" : "X16");
+    for(uint8_t bits : {1, 2, 4, 8}) {
+      glyph_t::bitmap_t bitmap = {32, bits, 0, 0, 64, 64, pixels.data()};
+      printf("%8.2f", ns_per_pixel(100 * 64 * 64, [&]() {
+        for(int i = 0; i < 100; i++) {
+          render_bitmap(bitmap, point_t<int>(10, 10));
+        }
+      }));
+    }
+
+    // the field covers about 100x100 pixels at this size
+    printf("%8.2f\n", ns_per_pixel(100 * 100 * 100, [&]() {
+      for(int i = 0; i < 100; i++) {
+        render_sdf(sdf, to_fixed(100), fixed_point(to_fixed(50), to_fixed(50)));
+      }
+    }));
+  }
+
+  return 0;
+}
@@ -68,11 +68,12 @@ void callback(const tile_t &tile) {
   
 
 
+  // pick the alpha map for the antialiasing level once per tile, not per pixel
+  const uint8_t *alpha_map = settings::antialias == X16 ? alpha_map_X16 : alpha_map_X4;
   uint8_t *p = tile.data;
   for(auto y = 0; y < tile.bounds.h; y++) {
     for(auto x = 0; x < tile.bounds.w; x++) {    
-      uint8_t value = settings::antialias == X4 ? alpha_map_X4[*p++] : alpha_map_X16[*p++];
-      image[y + tile.bounds.y][x + tile.bounds.x] = pen(255, 255, 255, value);
+      image[y + tile.bounds.y][x + tile.bounds.x] = pen(255, 255, 255, alpha_map[*p++]);
     }
     p += tile.stride - tile.bounds.w;
   }
@@ -91,9 +92,9 @@ int main() {
   for(int codepoint = 0; codepoint < 128; codepoint++) {
     render_character(tm, codepoint, caret);
 
-    if(tm.face.glyphs.count(codepoint) == 1) {
-      glyph_t glyph = tm.face.glyphs[codepoint];
-      caret.x += ((glyph.advance * tm.size) / 128) * 1.2;
+    const glyph_t *glyph = tm.face.find(codepoint);
+    if(glyph) {
+      caret.x += ((glyph->advance * tm.size) / 128) * 1.2;
       if(caret.x > 400) {
         caret.y += tm.size;
         caret.x = origin.x;
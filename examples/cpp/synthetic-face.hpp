@@ -0,0 +1,37 @@
+// made up faces for the benchmarks, include after alright-fonts.hpp
+
+#include <random>
+
+// builds a face of glyph_count made up glyphs with a spread of contour and
+// point counts similar to CJK glyphs, codepoints start at U+4E00
+vector<uint8_t> synthetic_face(uint16_t glyph_count) {
+  mt19937 random(glyph_count);
+  auto between = [&random](int low, int high) {return uniform_int_distribution<int>(low, high)(random);};
+
+  vector<uint8_t> dictionary, contours;
+  for(int i = 0; i < glyph_count; i++) {
+    size_t start = contours.size();
+    int contour_count = between(2, 12);
+    for(int c = 0; c < contour_count; c++) {
+      int point_count = between(4, 40);
+      contours.push_back(point_count >> 8);
+      contours.push_back(point_count & 0xff);
+      for(int p = 0; p < point_count * 2; p++) {
+        contours.push_back(uint8_t(between(-100, 100)));
+      }
+    }
+    contours.push_back(0);
+    contours.push_back(0);
+
+    uint16_t codepoint = 0x4e00 + i;
+    uint16_t length = contours.size() - start;
+    // bounds cover every point the glyph could have, -100 to 100 both ways
+    uint8_t entry[9] = {uint8_t(codepoint >> 8), uint8_t(codepoint), uint8_t(-100), uint8_t(-100), 200, 200, 110, uint8_t(length >> 8), uint8_t(length)};
+    dictionary.insert(dictionary.end(), entry, entry + 9);
+  }
+
+  vector<uint8_t> data = {'a', 'f', '!', '?', uint8_t(glyph_count >> 8), uint8_t(glyph_count), 0, 0};
+  data.insert(data.end(), dictionary.begin(), dictionary.end());
+  data.insert(data.end(), contours.begin(), contours.end());
+  return data;
+}
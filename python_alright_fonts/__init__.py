@@ -12,6 +12,7 @@ class Point():
     else:
       self.x = 0
       self.y = 0
+    self.control = False # off curve control point of a quadratic contour
     
   def scale(self, scale_x, scale_y=None):
     if not scale_y:
@@ -44,6 +45,7 @@ class Glyph():
     self.bbox_w = None
     self.bbox_h = None
     self.contours = []
+    self.details = [] # lower detail (max_size, contours) pairs, smallest first
   
   def __repr__(self):
     return "{} ({},{}: {}x{}) [{}]".format(self.codepoint, self.bbox_x, self.bbox_y, self.bbox_w, self.bbox_h, self.advance)
@@ -61,3 +63,4 @@ class Face():
 
 from python_alright_fonts.encoder import Encoder
 from python_alright_fonts.loader import load_font
+from python_alright_fonts.collection import pack_collection, load_collection
\ No newline at end of file
@@ -0,0 +1,132 @@
+import sys, struct
+from . import Glyph, Face
+from .loader import extract_glyph_contours, extract_detail_levels, glyph_entry_length, FLAG_SHARED_CONTOURS, FLAG_DETAIL_LEVELS, FLAG_QUADRATIC_CONTOURS, FLAG_ABSOLUTE_OFFSETS, SUPPORTED_FLAGS, OPTIONAL_FLAGS
+
+# collection encoding
+# ===========================================================================
+
+collection_header_length = 8
+collection_glyph_entry_length = 11
+
+# splits an Alright Fonts file into its flags, raw level table (empty unless
+# detail levels are in use), and glyph dictionary entries each paired with
+# the raw contour data for that glyph
+def split_font(data):
+  if data[:4] != b"af!?":
+    raise ValueError("invalid Alright Fonts file, no matching magic marker in header")
+
+  glyph_count, flags = struct.unpack(">HH", data[4:8])
+  if flags & ~SUPPORTED_FLAGS & ~OPTIONAL_FLAGS or flags & FLAG_DETAIL_LEVELS and flags & FLAG_QUADRATIC_CONTOURS:
+    raise ValueError("unsupported flags set in Alright Fonts file")
+
+  # optional data after the contours, such as embedded strikes, isn't
+  # carried over into collections
+  flags &= ~OPTIONAL_FLAGS
+
+  max_sizes, dictionary_offset = extract_detail_levels(data, 8, flags)
+  levels = data[8:dictionary_offset]
+
+  entry_length = glyph_entry_length(flags)
+  contour_offset = dictionary_offset + (glyph_count * entry_length)
+
+  # collection dictionaries always hold absolute offsets in their own layout
+  absolute_offsets = flags & FLAG_ABSOLUTE_OFFSETS
+  flags &= ~FLAG_ABSOLUTE_OFFSETS
+
+  glyphs = []
+  for i in range(0, glyph_count):
+    glyph_entry_offset = dictionary_offset + (i * entry_length)
+    metrics = data[glyph_entry_offset:glyph_entry_offset + 7]
+    contour_data_length = struct.unpack(">H", data[glyph_entry_offset + 7:glyph_entry_offset + 9])[0]
+    if absolute_offsets:
+      contour_offset = struct.unpack(">I", data[glyph_entry_offset + 9:glyph_entry_offset + 13])[0]
+    glyphs.append((metrics, data[contour_offset:contour_offset + contour_data_length]))
+    contour_offset += contour_data_length
+
+  return flags, levels, glyphs
+
+# packs a list of (name, font data) pairs into a single collection, the
+# contour data of any glyph that is identical to one already written (in
+# this face or another) is stored once and shared. contour references in
+# faces with shared contours are indices into that face's own contours so
+# their data is only ever shared within the face
+def pack_collection(fonts):
+  faces = [(name.encode("utf-8")[:255],) + split_font(data) for name, data in fonts]
+
+  directory_length = sum([1 + len(name) + 8 + len(levels) for name, flags, levels, glyphs in faces])
+  dictionaries_length = sum([len(glyphs) * collection_glyph_entry_length for name, flags, levels, glyphs in faces])
+  contour_offset = collection_header_length + directory_length + dictionaries_length
+
+  header = b"afc!" + struct.pack(">HH", len(faces), 0)
+
+  directory = bytes()
+  dictionaries = bytes()
+  contours = bytes()
+  shared = {}
+  for i, (name, flags, levels, glyphs) in enumerate(faces):
+    dictionary_offset = collection_header_length + directory_length + len(dictionaries)
+    directory += struct.pack(">B", len(name)) + name
+    directory += struct.pack(">HHI", len(glyphs), flags, dictionary_offset)
+    directory += levels
+
+    for metrics, contour_data in glyphs:
+      key = (i, contour_data) if flags & FLAG_SHARED_CONTOURS else contour_data
+      if key not in shared:
+        shared[key] = contour_offset + len(contours)
+        contours += contour_data
+      dictionaries += metrics + struct.pack(">I", shared[key])
+
+  return header + directory + dictionaries + contours
+
+# collection decoding
+# ===========================================================================
+
+# returns a list of (name, Face) pairs for each face in the collection
+def load_collection(file_or_name_or_bytes):
+  data = None
+  if isinstance(file_or_name_or_bytes, (bytes, bytearray)):
+    data = file_or_name_or_bytes
+  elif isinstance(file_or_name_or_bytes, str):
+    f = open(file_or_name_or_bytes, "rb")
+    data = f.read()
+    f.close()
+  else:
+    data = file_or_name_or_bytes.read()
+
+  if data[:4] != b"afc!":
+    print("> invalid Alright Fonts collection provided. no matching magic marker in header!")
+    sys.exit()
+
+  face_count = int.from_bytes(data[4:6], byteorder="big")
+
+  faces = []
+  offset = collection_header_length
+  for i in range(0, face_count):
+    name_length = data[offset]
+    name = data[offset + 1:offset + 1 + name_length].decode("utf-8")
+    offset += 1 + name_length
+    glyph_count, flags, dictionary_offset = struct.unpack(">HHI", data[offset:offset + 8])
+    offset += 8
+    max_sizes, offset = extract_detail_levels(data, offset, flags)
+
+    # contours seen so far in this face, when contour references are in use
+    table = [] if flags & FLAG_SHARED_CONTOURS else None
+
+    face = Face()
+    for j in range(0, glyph_count):
+      glyph = Glyph()
+      glyph_entry_offset = dictionary_offset + (j * collection_glyph_entry_length)
+      glyph.codepoint, glyph.bbox_x, glyph.bbox_y, glyph.bbox_w, \
+        glyph.bbox_h, glyph.advance, contour_offset = \
+        struct.unpack(
+          ">HbbBBBI", 
+          data[glyph_entry_offset:glyph_entry_offset + collection_glyph_entry_length]
+        )
+
+      extract_glyph_contours(data[contour_offset:], glyph, max_sizes, table, bool(flags & FLAG_QUADRATIC_CONTOURS))
+
+      face.glyphs[glyph.codepoint] = glyph
+
+    faces.append((name, face))
+
+  return faces
@@ -4,16 +4,132 @@ from . import Glyph, Point
 # contour encoding
 # ===========================================================================
 
-def pack_glyph_contours(glyph):
+# header flag marking that contour data may contain references to earlier
+# (possibly translated) copies of a contour instead of repeating its points
+FLAG_SHARED_CONTOURS = 0x0001
+
+# header flag marking that each glyph stores lower detail copies of its
+# contours for rendering at small sizes, see pack_detail_levels()
+FLAG_DETAIL_LEVELS = 0x0002
+
+# header flag marking that contours keep their quadratic curve control
+# points, each contour's points are preceded by a bitmask of which are off
+# curve control points
+FLAG_QUADRATIC_CONTOURS = 0x0004
+
+# header flag marking that each glyph dictionary entry is followed by the
+# 32-bit offset of its contour data from the start of the file
+FLAG_ABSOLUTE_OFFSETS = 0x0008
+
+# optional header flag (parsers may ignore it) marking that pre-rendered
+# coverage bitmaps for some pixel sizes follow the contour data
+FLAG_EMBEDDED_STRIKES = 0x0100
+
+# bits per pixel of embedded strike bitmaps
+STRIKE_BITS = 4
+
+# largest strike pixel size. glyph coordinates lie within -127..127 font
+# units and 128 units span size pixels, so at this size every bitmap is at
+# most 2 * size + 2 pixels wide or tall and its corner stays within the
+# signed byte range of the strike entries
+STRIKE_MAX_SIZE = 126
+
+# a contour reference is a 16-bit value with the top bit set, the lower 15
+# bits are the index of an earlier contour in the file followed by an x and
+# y offset as signed bytes
+CONTOUR_REFERENCE = 0x8000
+
+# tracks every contour packed so far so that later copies, even if moved,
+# can be written as references to the first
+class ContourTable():
+  def __init__(self):
+    self.count = 0
+    self.shapes = {}
+
+  # returns (index, dx, dy) for an earlier copy of contour or None and
+  # remembers the contour for future lookups
+  def find_or_add(self, contour):
+    origin = contour[0]
+    shape = tuple((p.x - origin.x, p.y - origin.y, p.control) for p in contour)
+
+    match = None
+    for index, first in self.shapes.get(shape, []):
+      dx, dy = origin.x - first.x, origin.y - first.y
+      if -128 <= dx <= 127 and -128 <= dy <= 127:
+        match = (index, dx, dy)
+        break
+
+    # every contour in the file has an index, including references, but
+    # only contours written out in full are useful to refer back to
+    if not match and self.count < CONTOUR_REFERENCE:
+      self.shapes.setdefault(shape, []).append((self.count, origin))
+    self.count += 1
+    return match
+
+# bit (i & 7) of byte i >> 3 is set if point i is an off curve control point
+def pack_control_bits(contour):
+  bits = bytearray((len(contour) + 7) // 8)
+  for i, point in enumerate(contour):
+    if point.control:
+      bits[i >> 3] |= 1 << (i & 7)
+  return bytes(bits)
+
+def pack_contours(contours, table=None, quadratic=False):
   result = bytes()
-  for contour in glyph.contours:      
+  for contour in contours:      
+    match = table.find_or_add(contour) if table and len(contour) > 0 else None
+    if match:
+      index, dx, dy = match
+      result += struct.pack(">Hbb", CONTOUR_REFERENCE | index, dx, dy)
+      continue
+
     result += struct.pack(">H", len(contour))
+    if quadratic:
+      result += pack_control_bits(contour)
     for point in contour:
       result += struct.pack(">bb", point.x, point.y)
   # end of contours marker
   result += struct.pack(">H", 0)
   return result      
 
+# lower detail levels are written first, smallest first, each with its own
+# end of contours marker followed by the full detail contours
+def pack_glyph_contours(glyph, table=None, quadratic=False):
+  result = bytes()
+  for max_size, contours in glyph.details:
+    result += pack_contours(contours, table)
+  return result + pack_contours(glyph.contours, table, quadratic)
+
+# the level table follows the header when detail levels are in use, the
+# number of levels stored per glyph then the largest pixel size each of the
+# lower levels is used for
+def pack_detail_levels(max_sizes):
+  return struct.pack(">B", len(max_sizes) + 1) + bytes(max_sizes)
+
+# packs 8-bit coverage values into bits per pixel, row by row and most
+# significant bits first
+def pack_bitmap(pixels, bits=STRIKE_BITS):
+  result = bytearray((len(pixels) * bits + 7) // 8)
+  maximum = (1 << bits) - 1
+  for i, pixel in enumerate(pixels):
+    value = (pixel * maximum + 127) // 255
+    bit = i * bits
+    result[bit >> 3] |= value << (8 - bits - (bit & 7))
+  return bytes(result)
+
+# a strike is its pixel size and bits per pixel, then the position and
+# size of each glyph bitmap in dictionary order, then the bitmaps. bitmaps
+# is a list of (x, y, w, h, pixels) tuples
+def pack_strike(size, bitmaps, bits=STRIKE_BITS):
+  result = struct.pack(">BB", size, bits)
+  for x, y, w, h, pixels in bitmaps:
+    if not (-128 <= x <= 127 and -128 <= y <= 127 and w <= 255 and h <= 255):
+      raise ValueError("a {}x{} glyph bitmap at {}, {} doesn't fit a size {} strike entry".format(w, h, x, y, size))
+    result += struct.pack(">bbBB", x, y, w, h)
+  for x, y, w, h, pixels in bitmaps:
+    result += pack_bitmap(pixels, bits)
+  return result
+
 class Segment():
   def __init__(self, start):
     self.start = start
@@ -69,7 +185,50 @@ class Segment():
     return points
   
 
-def load_glyph(face, codepoint, scale_factor, quality=1):
+def clamp_point(x, y):
+  return Point(max(-128, min(127, round(x))), max(-128, min(127, round(y))))
+
+# the two quadratics nearest a cubic curve, split in half, as [control,
+# middle, control]. the control point of each is where the tangents at
+# the ends of that half meet, approximated as (3 * (c1 + c2) - (p0 + p3)) / 4
+def cubic_to_quadratics(p0, c1, c2, p3):
+  middle = Segment.bezier_point(0.5, [p0, c1, c2, p3])
+  l1 = Point((p0.x + c1.x) / 2, (p0.y + c1.y) / 2)
+  l2 = Point((p0.x + 2 * c1.x + c2.x) / 4, (p0.y + 2 * c1.y + c2.y) / 4)
+  r1 = Point((c1.x + 2 * c2.x + p3.x) / 4, (c1.y + 2 * c2.y + p3.y) / 4)
+  r2 = Point((c2.x + p3.x) / 2, (c2.y + p3.y) / 2)
+  points = [
+    clamp_point((3 * (l1.x + l2.x) - (p0.x + middle.x)) / 4, (3 * (l1.y + l2.y) - (p0.y + middle.y)) / 4),
+    clamp_point(middle.x, middle.y),
+    clamp_point((3 * (r1.x + r2.x) - (middle.x + p3.x)) / 4, (3 * (r1.y + r2.y) - (middle.y + p3.y)) / 4)
+  ]
+  points[0].control = points[2].control = True
+  return points
+
+# builds a contour that keeps its curves as on curve points and quadratic
+# control points. truetype curves map directly, consecutive control points
+# imply an on curve point halfway between them in both, while cubic curves
+# are each replaced by two quadratics
+def quadratic_contour(points, tags):
+  contour = []
+  i = 0
+  while i < len(points):
+    tag = tags[i] & 0b11
+    if tag == 0b10 and i + 1 < len(points) and tags[i + 1] & 0b11 == 0b10:
+      # cubic control pair, the end point wraps around to the start
+      start = contour[-1] if contour else points[-1]
+      end = points[(i + 2) % len(points)]
+      contour += cubic_to_quadratics(start, points[i], points[i + 1], end)
+      i += 2
+      continue
+
+    point = Point(points[i].x, points[i].y)
+    point.control = tag != 0b01
+    contour.append(point)
+    i += 1
+  return contour
+
+def load_glyph(face, codepoint, scale_factor, quality=1, quadratic=False):
   # glyph doesn't exist in face
   if face.get_char_index(codepoint) == 0:
     return None
@@ -102,6 +261,12 @@ def load_glyph(face, codepoint, scale_factor, quality=1):
     points = [Point(p) for p in outline.points[start:end + 1]]
     tags = outline.tags[start:end + 1]
 
+    if quadratic:
+      points = [p.scale(scale_factor, -scale_factor).round() for p in points]
+      glyph.contours.append(quadratic_contour(points, tags))
+      start = end + 1
+      continue
+
     # attach start point to end to close the loop
     points.append(points[0])
     tags.append(tags[0])
@@ -141,7 +306,14 @@ def load_glyph(face, codepoint, scale_factor, quality=1):
   return glyph
     
 class Encoder():
-  def __init__(self, font, quality = 1):
+  # detail_levels is an optional list of (max_size, quality) pairs, smallest
+  # first, for lower detail copies of each glyph used at small pixel sizes
+  # with quadratic set curves are stored as control points rather than
+  # flattened and quality has no effect
+  # strike_sizes is an optional list of pixel sizes to embed pre-rendered
+  # bitmaps of every glyph for. with absolute_offsets the dictionary entries
+  # hold where their contour data starts so glyphs can be read in any order
+  def __init__(self, font, quality = 1, shared_contours = False, detail_levels = None, quadratic = False, strike_sizes = None, absolute_offsets = False):
     self.face = freetype.Face(font)
     self.bbox_l = self.face.bbox.xMin
     self.bbox_t = self.face.bbox.yMin
@@ -152,6 +324,27 @@ class Encoder():
 
     self.quality = quality
 
+    # when set identical contours are written once and referenced after
+    self.flags = FLAG_SHARED_CONTOURS if shared_contours else 0
+    self.contour_table = ContourTable() if shared_contours else None
+
+    self.detail_levels = detail_levels or []
+    if self.detail_levels:
+      self.flags |= FLAG_DETAIL_LEVELS
+
+    self.quadratic = quadratic
+    if quadratic:
+      self.flags |= FLAG_QUADRATIC_CONTOURS
+
+    self.strike_sizes = strike_sizes or []
+    if self.strike_sizes:
+      self.flags |= FLAG_EMBEDDED_STRIKES
+
+    self.glyph_entry_length = 9
+    if absolute_offsets:
+      self.flags |= FLAG_ABSOLUTE_OFFSETS
+      self.glyph_entry_length = 13
+
     normalising_scale_factor = max(
       abs(self.bbox_l), abs(self.bbox_t), 
       abs(self.bbox_r), abs(self.bbox_b))
@@ -172,18 +365,56 @@ class Encoder():
 
   def get_glyph(self, codepoint):
     if codepoint not in self.glyphs:
-      glyph = load_glyph(self.face, codepoint, self.scale_factor, self.quality)
+      glyph = load_glyph(self.face, codepoint, self.scale_factor, self.quality, self.quadratic)
       if not glyph:
         return None
+      for max_size, quality in self.detail_levels:
+        detail = load_glyph(self.face, codepoint, self.scale_factor, quality)
+        glyph.details.append((max_size, detail.contours))
       self.glyphs[codepoint] = glyph
     return self.glyphs[codepoint]
 
-  def get_packed_glyph(self, glyph):
-    self.packed_glyph_contours[glyph.codepoint] = pack_glyph_contours(glyph)
+  # renders a glyph with freetype at the pixel size a renderer would draw it
+  # at, where 128 font units span size pixels, as (x, y, w, h, pixels) with
+  # x and y the top left corner relative to the origin
+  def render_bitmap(self, codepoint, size):
+    ppem = size * self.scale_factor * self.face.units_per_EM / 128
+    self.face.set_char_size(0, round(ppem * 64), 72, 72)
+    self.face.load_char(codepoint, freetype.FT_LOAD_RENDER)
+    bitmap = self.face.glyph.bitmap
+    pixels = []
+    for row in range(0, bitmap.rows):
+      pixels += bitmap.buffer[row * bitmap.pitch:row * bitmap.pitch + bitmap.width]
+    return (self.face.glyph.bitmap_left, -self.face.glyph.bitmap_top, bitmap.width, bitmap.rows, pixels)
+
+  # strikes that follow the contour data, empty without strike sizes. the
+  # glyphs are in the same order as the dictionary
+  def get_packed_strikes(self):
+    if not self.strike_sizes:
+      return bytes()
+    result = struct.pack(">B", len(self.strike_sizes))
+    for size in self.strike_sizes:
+      bitmaps = [self.render_bitmap(codepoint, size) for codepoint in self.glyphs.keys()]
+      result += pack_strike(size, bitmaps)
+    return result
+
+  # level table that follows the header, empty without detail levels
+  def get_packed_detail_levels(self):
+    if not self.detail_levels:
+      return bytes()
+    return pack_detail_levels([max_size for max_size, quality in self.detail_levels])
+
+  # contour_offset is where the glyph's contour data will be written in the
+  # file, only stored with absolute offsets
+  def get_packed_glyph(self, glyph, contour_offset = 0):
+    self.packed_glyph_contours[glyph.codepoint] = pack_glyph_contours(glyph, self.contour_table, self.quadratic)
     pack_format = ">HbbBBBH"
-    return struct.pack(pack_format, glyph.codepoint, 
+    result = struct.pack(pack_format, glyph.codepoint, 
       glyph.bbox_x, glyph.bbox_y, glyph.bbox_w, glyph.bbox_h, glyph.advance, 
       len(self.packed_glyph_contours[glyph.codepoint]))
+    if self.flags & FLAG_ABSOLUTE_OFFSETS:
+      result += struct.pack(">I", contour_offset)
+    return result
 
   def get_packed_glyph_contours(self, glyph):
     return self.packed_glyph_contours[glyph.codepoint]
\ No newline at end of file
@@ -1,10 +1,53 @@
 import sys, struct
 from . import Glyph, Point, Face
 
-def extract_contours(data):
-  contours = []
+# header flags supported by this loader
+FLAG_SHARED_CONTOURS = 0x0001
+FLAG_DETAIL_LEVELS = 0x0002
+FLAG_QUADRATIC_CONTOURS = 0x0004
+FLAG_ABSOLUTE_OFFSETS = 0x0008
+FLAG_EMBEDDED_STRIKES = 0x0100
+SUPPORTED_FLAGS = FLAG_SHARED_CONTOURS | FLAG_DETAIL_LEVELS | FLAG_QUADRATIC_CONTOURS | FLAG_ABSOLUTE_OFFSETS
+
+# flags in the top byte are optional, their data follows the contour data
+# and is safe to ignore. embedded strikes are only useful to renderers
+OPTIONAL_FLAGS = 0xff00
+CONTOUR_REFERENCE = 0x8000
+
+# length of each glyph dictionary entry, with absolute offsets the entry is
+# followed by the offset of the glyph's contour data from the start of file
+def glyph_entry_length(flags):
+  return 13 if flags & FLAG_ABSOLUTE_OFFSETS else 9
+
+# reads the level table at offset if the detail levels flag is set, returns
+# the largest pixel size of each lower detail level and the offset after it
+def extract_detail_levels(data, offset, flags):
+  if not flags & FLAG_DETAIL_LEVELS:
+    return [], offset
+  level_count = data[offset]
+  return list(data[offset + 1:offset + level_count]), offset + level_count
 
+# reads the contours of a glyph into glyph.contours and, if max_sizes is
+# given, the lower detail levels that precede them into glyph.details
+def extract_glyph_contours(data, glyph, max_sizes=(), table=None, quadratic=False):
   offset = 0
+  glyph.details = []
+  for max_size in max_sizes:
+    contours, offset = extract_contours_at(data, offset, table)
+    glyph.details.append((max_size, contours))
+  glyph.contours, offset = extract_contours_at(data, offset, table, quadratic)
+
+# table is the list of contours read so far from the file, required if the
+# file has the shared contours flag set. with quadratic set the points of
+# each contour are marked with whether they're off curve control points
+def extract_contours(data, table=None, quadratic=False):
+  return extract_contours_at(data, 0, table, quadratic)[0]
+
+# as extract_contours() but starting at offset, returns the contours and the
+# offset after their end marker
+def extract_contours_at(data, offset, table=None, quadratic=False):
+  contours = []
+
   while True:
     point_count = struct.unpack(">H", data[offset + 0:offset + 2])[0]
     offset += 2
@@ -13,19 +56,36 @@ def extract_contours(data):
 
     contour = []
 
-    # load points of contour
-    for j in range(0, point_count):
-      point = Point()           
-      point.x, point.y = struct.unpack(
-        ">bb", 
-        data[offset + 0:offset + 2]
-      )
+    if table is not None and point_count & CONTOUR_REFERENCE:
+      # reference to an earlier contour, moved by an offset
+      dx, dy = struct.unpack(">bb", data[offset + 0:offset + 2])
       offset += 2
-      contour.append(point)
+      for p in table[point_count & ~CONTOUR_REFERENCE]:
+        point = Point(p.x + dx, p.y + dy)
+        point.control = p.control
+        contour.append(point)
+    else:
+      # bitmask of off curve control points
+      control = data[offset:offset + (point_count + 7) // 8] if quadratic else None
+      if quadratic:
+        offset += len(control)
+
+      # load points of contour
+      for j in range(0, point_count):
+        point = Point()           
+        point.x, point.y = struct.unpack(
+          ">bb", 
+          data[offset + 0:offset + 2]
+        )
+        offset += 2
+        point.control = bool(control and control[j >> 3] & (1 << (j & 7)))
+        contour.append(point)
 
+    if table is not None:
+      table.append(contour)
     contours.append(contour)
 
-  return contours
+  return contours, offset
 
 def load_font(file_or_name_or_bytes):
   face = Face()
@@ -47,24 +107,36 @@ def load_font(file_or_name_or_bytes):
 
   glyph_count = int.from_bytes(data[4:6], byteorder="big")
   flags = int.from_bytes(data[6:8], byteorder="big")
+  if flags & ~SUPPORTED_FLAGS & ~OPTIONAL_FLAGS or flags & FLAG_DETAIL_LEVELS and flags & FLAG_QUADRATIC_CONTOURS:
+    print("> unsupported flags set in Alright Fonts file header!")
+    sys.exit()
+
+  # contours seen so far, when contour references are in use
+  table = [] if flags & FLAG_SHARED_CONTOURS else None
   
-  glyph_entry_length = 9
+  # optional level table follows the header
+  max_sizes, dictionary_offset = extract_detail_levels(data, 8, flags)
+
+  entry_length = glyph_entry_length(flags)
 
   # contours start at end of glyph dictionary
-  contour_offset = 8 + (glyph_count * glyph_entry_length)
+  contour_offset = dictionary_offset + (glyph_count * entry_length)
 
   for i in range(0, glyph_count):        
     glyph = Glyph()    
-    glyph_entry_offset = 8 + (i * glyph_entry_length)
+    glyph_entry_offset = dictionary_offset + (i * entry_length)
     glyph.codepoint, glyph.bbox_x, glyph.bbox_y, glyph.bbox_w, \
       glyph.bbox_h, glyph.advance, contour_data_length = \
       struct.unpack(
         ">HbbBBBH", 
-        data[glyph_entry_offset:glyph_entry_offset + glyph_entry_length]
+        data[glyph_entry_offset:glyph_entry_offset + 9]
       )
+    if flags & FLAG_ABSOLUTE_OFFSETS:
+      contour_offset = struct.unpack(">I", data[glyph_entry_offset + 9:glyph_entry_offset + 13])[0]
 
-    glyph.contours = extract_contours(
-      data[contour_offset:contour_offset + contour_data_length]
+    extract_glyph_contours(
+      data[contour_offset:contour_offset + contour_data_length], glyph, max_sizes, table,
+      bool(flags & FLAG_QUADRATIC_CONTOURS)
     )
     contour_offset += contour_data_length
 